@@ -7,11 +7,52 @@
 #include <cstdlib>
 #include "connection.h"
 #include "grid.hpp"
+#include "flatgrid.hpp"
+#include "mortoncelllist.hpp"
+#include "neighbourlists.hpp"
+#include "multilevelgrid.hpp"
+#include "gridtuner.hpp"
+#include "trianglebvh.hpp"
 #include "model.h"
 #include "modelconnection.hpp"
+#include "threadpool.hpp"
+#include "connectioncolouring.hpp"
+#include "kinematicstore.hpp"
+#include "objectpool.hpp"
 
 using namespace std;
 namespace MecaCell {
+// how the cell-cell connection forces are accumulated into the cells:
+// - serial: connections apply their forces directly, one after the other
+// - buffered: connections are computed concurrently into a world-owned contribution
+// buffer, at their position in the connections vector (Connection::computeForces<true>),
+// then each cell gathers the contributions of its
+// connections in the order of its connection list. Results do not depend on the nb of
+// threads. minLengthRatio corrections are computed from the pre-step state and summed.
+// - coloured: connections are split into batches sharing no cell (ConnectionColouring),
+// each batch is computed concurrently with direct writes into the cells.
+enum class ForceAssembly { serial, buffered, coloured };
+
+// spatial structure used to find the cell-cell collision candidates. Every mode tests
+// each candidate pair once, without per cell state:
+// - grid: Grid (hashmap of vectors), also used by the viewer. A cell is in every bucket
+// its bounding cube overlaps, a pair is reported from the first bucket both cells share
+// - flatGrid: FlatGrid (open addressing + one contiguous item array), same as grid
+// - cellList: MortonCellList (cells sorted by Z-order key, built on the thread pool),
+// with a half shell enumeration
+// - multiLevel: MultiLevelGrid (one cell list per radius class), for populations mixing
+// very different radii
+enum class BroadPhase { grid, flatGrid, cellList, multiLevel };
+
+// spatial structure used to find the cell-model collision candidates:
+// - grid: one Grid shared by all the models, faces rasterized into its buckets (in world
+// space: every face is reinserted when a model moves)
+// - bvh: one TriangleBVH per model, in model space: it is only rebuilt when the number of
+// faces changes, and cells are brought into model space (Model::toModelSpace) to be
+// queried, so moving a model is O(1). Candidates are the faces whose bounding box
+// touches the cell
+enum class ModelBroadPhase { grid, bvh };
+
 template <typename Cell, typename Integrator> class BasicWorld {
 
 protected:
@@ -27,10 +68,45 @@ protected:
 
 	// hashmap containing cells
 	Grid<Cell *> grid = Grid<Cell *>(5.0 * DEFAULT_CELL_RADIUS);
+	FlatGrid<Cell *> flatGrid = FlatGrid<Cell *>(5.0 * DEFAULT_CELL_RADIUS);
+	MortonCellList<Cell *> cellList = MortonCellList<Cell *>(5.0 * DEFAULT_CELL_RADIUS);
+	MultiLevelGrid<Cell *> multiLevelGrid = MultiLevelGrid<Cell *>(2.5 * DEFAULT_CELL_RADIUS);
+	BroadPhase broadPhase = BroadPhase::grid;
+	// grid is maintained with Grid::update instead of being rebuilt every frame
+	bool incrementalGrid = false;
+	// when enabled, cell-cell collisions use Verlet lists instead of the broad phase above
+	bool useNeighbourLists = false;
+	NeighbourLists<Cell> neighbourLists = NeighbourLists<Cell>(0.5 * DEFAULT_CELL_RADIUS);
+
+	// connections are allocated from these pools (they must outlive the containers below)
+	ObjectPool<Connection<Cell *>> connectionPool;
+	ObjectPool<Cell> cellPool; // cells created by newCell and their daughters
 
 	// model grid containting pair<model_ptr, face_id>
 	Grid<std::pair<Model *, unsigned int>> modelGrid =
 	    Grid<std::pair<Model *, unsigned int>>(100);
+	// per model BVHs (ModelBroadPhase::bvh)
+	unordered_map<Model *, TriangleBVH> modelBVHs;
+	ModelBroadPhase modelBroadPhase = ModelBroadPhase::grid;
+	// scratch buffer for the cell-model broad phase
+	vector<pair<Model *, unsigned int>> modelCandidates;
+	// scratch, cell-model connections created during a collision check
+	vector<CellModelConnection<Cell>> newModelConnections;
+
+	// automatic cell size of the grids (cell grid in grid & flatGrid modes, model grid)
+	bool gridTuning = false;
+	GridTuner cellGridTuner, modelGridTuner;
+	size_t nbCellCandidates = 0, nbModelCandidates = 0; // during the current frame
+	size_t nbCellQueries = 0, nbModelQueries = 0;
+
+	// periodic sort of the cells along the Z-order curve (see setCellReordering)
+	size_t reorderPeriod = 0;
+	double reorderMaxDegradation = 0;
+	double locality = 0, localityAfterReorder = 0;
+	size_t nbReorderings = 0;
+	vector<pair<Cell *, size_t>> cellIndices; // scratch, sorted by cell
+	// buckets of about one cell, so that the order follows the curve at the cell level
+	MortonCellList<Cell *> reorderList = MortonCellList<Cell *>(DEFAULT_CELL_RADIUS);
 
 	// enabled collisions
 	bool cellCellCollisions = true;
@@ -43,6 +119,22 @@ protected:
 	// threshold (dot product) above which we consider two connections to be merged
 	const double MIN_CONNECTION_SIMILARITY = 0.8;
 
+	// workers used to split the update phases (1 thread = serial update)
+	ThreadPool threadPool;
+	bool parallelCellStats = false; // Cell::updateStats() called from the workers
+	ForceAssembly forceAssembly = ForceAssembly::serial;
+	// only used when forceAssembly == buffered: what connection i did to its nodes is at
+	// 2 * i and 2 * i + 1
+	vector<NodeContribution> contributions;
+	// only maintained when forceAssembly == coloured
+	ConnectionColouring<Connection<Cell *>> colouring;
+	bool colouringDirty = false; // see connectionsModified
+
+	// structure of arrays mode: the cells' kinematic state lives in kinematics, at the
+	// same index as the cell in the cells vector
+	bool structureOfArrays = false;
+	KinematicStore kinematics, kinematicsBuffer;
+
 public:
 	using cell_type = Cell;
 	using integrator_type = Integrator;
@@ -59,10 +151,10 @@ public:
 	// all models are stored in this map, using their name as the key
 	unordered_map<string, Model> models;
 
-	// cells to models connections are stored in a double map model* -> cell*
-	unordered_map<Model *,
-	              unordered_map<Cell *, vector<unique_ptr<CellModelConnection<Cell>>>>>
-	    cellModelConnections;
+	// cells to models connections, stored contiguously and sorted by (cell, model) between
+	// two collision checks. Cells point to theirs (getRWModelConnections), so these
+	// pointers are refreshed whenever this vector is modified by the world
+	vector<modelConnect_type> cellModelConnections;
 
 	/**********************************************
 	 *                 GET & SET                  *
@@ -70,9 +162,110 @@ public:
 	Vec getG() const { return g; }
 	void setG(const Vec &v) { g = v; }
 	const Grid<Cell *> &getCellGrid() { return grid; }
+	const FlatGrid<Cell *> &getFlatCellGrid() { return flatGrid; }
+	const MortonCellList<Cell *> &getCellList() { return cellList; }
+	const MultiLevelGrid<Cell *> &getMultiLevelGrid() { return multiLevelGrid; }
+	// periodically re-buckets the cell & model grids with the cell size minimizing the
+	// GridTuner cost model (see getCellGridTuner / getModelGridTuner for its statistics)
+	bool getGridTuning() const { return gridTuning; }
+	void setGridTuning(bool t) { gridTuning = t; }
+	GridTuner &getCellGridTuner() { return cellGridTuner; }
+	GridTuner &getModelGridTuner() { return modelGridTuner; }
+	// Every period frames (0 = never), the cells vector is sorted along the Z-order curve
+	// of their positions, and the connections by their first node, so that neighbours are
+	// processed together (and are close in memory in structure of arrays mode). If
+	// maxDegradation > 0, it only happens when the locality got worse than maxDegradation
+	// times its value right after the previous reordering.
+	void setCellReordering(size_t period, double maxDegradation = 0) {
+		reorderPeriod = period;
+		reorderMaxDegradation = maxDegradation;
+	}
+	size_t getCellReorderingPeriod() const { return reorderPeriod; }
+	double getLocality() const { return locality; } // last measured
+	size_t getNbReorderings() const { return nbReorderings; }
+	bool getIncrementalGrid() const { return incrementalGrid; }
+	void setIncrementalGrid(bool i) {
+		incrementalGrid = i;
+		grid.clear();
+	}
+	bool getUseNeighbourLists() const { return useNeighbourLists; }
+	void setUseNeighbourLists(bool n) {
+		useNeighbourLists = n;
+		neighbourLists.invalidate();
+	}
+	// lists are rebuilt when a cell moved by more than skin / 2
+	double getNeighbourSkin() const { return neighbourLists.getSkin(); }
+	void setNeighbourSkin(double s) { neighbourLists.setSkin(s); }
+	// rebuild statistics
+	const NeighbourLists<Cell> &getNeighbourLists() const { return neighbourLists; }
+	BroadPhase getBroadPhase() const { return broadPhase; }
+	// the structure that is not selected is left empty
+	void setBroadPhase(BroadPhase b) {
+		broadPhase = b;
+		grid.clear();
+		flatGrid.clear();
+		cellList.clear();
+		multiLevelGrid.clear();
+	}
 	const Grid<pair<Model *, unsigned int>> &getModelGrid() { return modelGrid; }
+	const unordered_map<Model *, TriangleBVH> &getModelBVHs() { return modelBVHs; }
+	ModelBroadPhase getModelBroadPhase() const { return modelBroadPhase; }
+	// the structure that is not selected is left empty
+	void setModelBroadPhase(ModelBroadPhase b) {
+		modelBroadPhase = b;
+		modelGrid.clear();
+		modelBVHs.clear();
+		if (b == ModelBroadPhase::grid)
+			for (auto &m : models) insertInGrid(m.second);
+		else
+			for (auto &m : models) updateBVH(m.second);
+	}
+	const ObjectPool<connect_type> &getConnectionPool() const { return connectionPool; }
+	const ObjectPool<Cell> &getCellPool() const { return cellPool; }
 	double getViscosityCoef() const { return viscosityCoef; }
 	void setViscosityCoef(const double d) { viscosityCoef = d; }
+	// nb of threads used by update() (0 = hardware concurrency). Only the phases that
+	// touch each cell or connection independently are split, so results do not depend on
+	// this number. User code is still called from the calling thread only, unless stated
+	// otherwise (see setParallelCellStats).
+	void setNbThreads(size_t n) { threadPool.setNbThreads(n); }
+	size_t getNbThreads() const { return threadPool.getNbThreads(); }
+	ThreadPool &getThreadPool() { return threadPool; }
+	// off by default. When on, Cell::updateStats() is called on the update's threads, so it
+	// must be thread safe (only touch its own cell)
+	bool getParallelCellStats() const { return parallelCellStats; }
+	void setParallelCellStats(bool p) { parallelCellStats = p; }
+	ForceAssembly getForceAssembly() const { return forceAssembly; }
+	void setForceAssembly(ForceAssembly f) {
+		forceAssembly = f;
+		colouringDirty = false;
+		if (f != ForceAssembly::buffered) vector<NodeContribution>().swap(contributions);
+		if (f == ForceAssembly::coloured)
+			colouring.rebuild(connections);
+		else
+			colouring.clear();
+	}
+	const ConnectionColouring<Connection<Cell *>> &getColouring() const { return colouring; }
+	// to be called after adding or removing connections outside of update() (the world
+	// cannot see changes made directly to the connections vector)
+	void connectionsModified() { colouringDirty = true; }
+	bool getStructureOfArrays() const { return structureOfArrays; }
+	const KinematicStore &getKinematicStore() const { return kinematics; }
+	// only available when compiled with MECACELL_STRUCTURE_OF_ARRAYS=1
+	void setStructureOfArrays(bool soa) {
+		if (soa && !MECACELL_STRUCTURE_OF_ARRAYS) {
+			MECACELL_WARNING("structure of arrays mode needs MECACELL_STRUCTURE_OF_ARRAYS=1");
+			return;
+		}
+		structureOfArrays = soa;
+		if (soa) {
+			kinematics.resize(cells.size());
+			for (size_t i = 0; i < cells.size(); ++i) cells[i]->bindKinematicStore(&kinematics, i);
+		} else {
+			for (auto &c : cells) c->unbindKinematicStore();
+			kinematics.clear();
+		}
+	}
 
 	/**********************************************
 	 *             MAIN UPDATE ROUTINE            *
@@ -86,9 +279,7 @@ public:
 				checkForCellModellCollisions();
 			}
 			if (cellCellCollisions) {
-				grid.clear();
-				for (const auto &c : cells)
-					grid.insert(c);
+				updateCellGrid();
 				updateConnectionsLengthAndDirection();
 				cellCollisions();
 				deleteImpossibleConnections();
@@ -97,6 +288,13 @@ public:
 			destroyCells();
 			updateStats();
 			resetForces();
+			if (gridTuning) tuneGrids();
+			if (reorderPeriod > 0 && frame % reorderPeriod == 0) {
+				locality = computeLocality();
+				if (reorderMaxDegradation <= 0 ||
+				    locality > reorderMaxDegradation * localityAfterReorder)
+					reorderCells();
+			}
 		}
 		++frame;
 	}
@@ -109,39 +307,75 @@ public:
 	 *           FORCES           *
 	 ******************************/
 
+	// also where the moments of inertia are copied to the kinematic store, so that the
+	// integration does not have to touch the cells in structure of arrays mode
 	void updateStats() {
-		for (auto &c : cells) {
+		auto stats = [&](size_t i) {
+			Cell *c = cells[i];
 			c->updateStats();
-		}
+			if (structureOfArrays) kinematics.momentOfInertia[i] = c->getMomentOfInertia();
+		};
+		if (parallelCellStats)
+			threadPool.parallelFor(cells.size(), stats);
+		else
+			for (size_t i = 0; i < cells.size(); ++i) stats(i);
 	}
 
 	void setDt(double d) { dt = d; }
 
-	void computeForces() {
-		// connections
-		for (auto &con : connections)
-			con->computeForces(dt);
-		for (auto &m : cellModelConnections) {
-			// model* -> cell* -> vec<connection>
-			for (auto &c : m.second) {
-				for (auto &cmc : c.second) {
-					cmc->computeForces(dt);
+	void computeConnectionForces() {
+		switch (forceAssembly) {
+			case ForceAssembly::buffered:
+				contributions.resize(2 * connections.size());
+				threadPool.parallelFor(connections.size(), [&](size_t i) {
+					connections[i]->setContributionId(i);
+					connections[i]->template computeForces<true>(dt, &contributions[2 * i]);
+				});
+				threadPool.parallelFor(cells.size(), [&](size_t i) {
+					Cell *c = cells[i];
+					for (auto &con : c->getRWConnections())
+						contributions[2 * con->getContributionId() + con->getNodeIndex(c)].applyTo(*c);
+				});
+				break;
+			case ForceAssembly::coloured:
+				if (colouringDirty) {
+					colouring.rebuild(connections);
+					colouringDirty = false;
+				} else if (colouring.getNbRemovedSinceCompaction() > colouring.size() / 4) {
+					colouring.compact();
 				}
-			}
+				assert(colouring.size() == connections.size());
+				for (auto &batch : colouring.getBatches())
+					threadPool.parallelFor(batch.size(), [&](size_t i) { batch[i]->computeForces(dt); });
+				break;
+			default:
+				for (auto &con : connections) con->computeForces(dt);
 		}
+	}
 
-		for (auto &c : cells) {
+	void computeForces() {
+		// connections
+		computeConnectionForces();
+		for (auto &cmc : cellModelConnections) cmc.computeForces(dt);
+
+		threadPool.parallelFor(cells.size(), [&](size_t i) {
+			Cell *c = cells[i];
 			// friction
 			c->receiveForce(-6.0 * M_PI * viscosityCoef * c->getRadius() * c->getVelocity());
 			// gravity
 			c->receiveForce(g);
-		}
+		});
 	}
 
 	void resetForces() {
-		for (auto cIt = cells.begin(); cIt < cells.end(); ++cIt) {
-			(*cIt)->resetForce();
-			(*cIt)->resetTorque();
+		if (structureOfArrays) {
+			threadPool.parallelForRanges(
+			    cells.size(), [&](size_t b, size_t e, size_t) { kinematics.resetForces(b, e); });
+		} else {
+			threadPool.parallelFor(cells.size(), [&](size_t i) {
+				cells[i]->resetForce();
+				cells[i]->resetTorque();
+			});
 		}
 	}
 
@@ -151,7 +385,8 @@ public:
 	}
 
 	void updateConnectionsLengthAndDirection() {
-		for (auto &c : connections) {
+		threadPool.parallelFor(connections.size(), [&](size_t i) {
+			connect_type *c = connections[i];
 			double contactSurface =
 			    M_PI *
 			    (pow(c->getSc().length, 2) +
@@ -161,14 +396,17 @@ public:
 			c->getTorsion().first.setCurrentKCoef(contactSurface);
 			c->getTorsion().second.setCurrentKCoef(contactSurface);
 			c->updateLengthDirection();
-		}
+		});
 	}
 
 	void updatePositionsAndOrientations() {
-		for (auto cIt = cells.begin(); cIt < cells.end(); ++cIt) {
-			Cell *c = *cIt;
-			updateCellPos(*c, dt);
-			c->markAsNotTested();
+		if (structureOfArrays) {
+			threadPool.parallelFor(cells.size(), [&](size_t i) {
+				KinematicStore::Slot s(kinematics, i);
+				updateCellPos(s, dt);
+			});
+		} else {
+			threadPool.parallelFor(cells.size(), [&](size_t i) { updateCellPos(*cells[i], dt); });
 		}
 	}
 
@@ -180,37 +418,48 @@ public:
 		models.at(name).name = name;
 	}
 	void removeModel(const string &name) {
-		if (models.count(name)) {
-			models.erase(name);
-		}
-		if (cellModelConnections.count(name)) {
-			cerr << "deleting stuff" << endl;
-			for (auto &c : cellModelConnections.at(name)) {
-				for (auto &conn : c.second) {
-					c.first->removeModelConnection(conn.second.get());
-				}
-			}
-			cerr << "ok" << endl;
-			cellModelConnections.erase(name);
-		}
+		if (!models.count(name)) return;
+		Model *m = &models.at(name);
+		MECACELL_DEBUG("removing model " << name << " and its connections");
+		eraseModelConnections([&](const modelConnect_type &cmc) { return cmc.model == m; });
+		modelBVHs.erase(m);
+		models.erase(name);
 		modelGrid.clear();
-		for (auto &m : models) {
-			insertInGrid(m.second);
+		if (modelBroadPhase == ModelBroadPhase::grid) {
+			for (auto &m : models) {
+				insertInGrid(m.second);
+			}
 		}
 	}
 
 	void insertInGrid(Model &m) {
+		const auto &v = m.getVertices();
 		for (size_t i = 0; i < m.faces.size(); ++i) {
 			auto &f = m.faces[i];
-			modelGrid.insert({&m, i}, m.vertices[f.indices[0]], m.vertices[f.indices[1]],
-			                 m.vertices[f.indices[2]]);
+			modelGrid.insert({&m, i}, v[f.indices[0]], v[f.indices[1]], v[f.indices[2]]);
 		}
 	}
 
+	// builds the (model space) BVH of m if it does not match its faces, refits it if m was
+	// deformed. Rigid moves and scalings keep it as is (queries are made in model space)
+	void updateBVH(Model &m) {
+		TriangleBVH &bvh = modelBVHs[&m];
+		const bool deformed = m.deformedSinceLastCheck();
+		if (bvh.empty() || bvh.getNbTriangles() != m.faces.size())
+			bvh.build(m.obj.vertices, m.faces);
+		else if (deformed)
+			bvh.refit(m.obj.vertices, m.faces);
+	}
+
 	/******************************
 	 *         COLLISIONS         *
 	 ******************************/
 	void updateModelGrid() {
+		if (modelBroadPhase == ModelBroadPhase::bvh) {
+			for (auto &m : models)
+				if (m.second.changedSinceLastCheck()) updateBVH(m.second);
+			return;
+		}
 		bool modelChange = false;
 		for (auto &m : models) {
 			if (m.second.changedSinceLastCheck()) {
@@ -225,34 +474,162 @@ public:
 		}
 	}
 
-	void checkForCellModellCollisions() {
-		// first, we set all connections to dirty
-		for (auto &m : cellModelConnections) {
-			for (auto &c : m.second) {
-				for (auto &conn : c.second) {
-					conn->dirty = true;
-				}
+	// sample of at most 256 radii
+	template <typename C, typename F> static vector<double> sampleRadii(const C &c, F radius) {
+		vector<double> res;
+		size_t stride = max<size_t>(1, c.size() / 256);
+		for (size_t i = 0; i < c.size(); i += stride) res.push_back(radius(c[i]));
+		return res;
+	}
+
+	void tuneGrids() {
+		auto cellRadius = [](const Cell *c) { return c->getRadius(); };
+		if (cellCellCollisions && !useNeighbourLists && cellGridTuner.isDue(frame) &&
+		    (broadPhase == BroadPhase::grid || broadPhase == BroadPhase::flatGrid)) {
+			GridMeasure m;
+			m.cellSize = grid.getCellSize();
+			m.nbStored = m.nbQueries = nbCellQueries; // every cell inserted is queried
+			m.storedRadii = m.queryRadii = sampleRadii(cells, cellRadius);
+			if (nbCellQueries > 0)
+				m.candidatesPerQuery = static_cast<double>(nbCellCandidates) / nbCellQueries;
+			m.occupancy = broadPhase == BroadPhase::grid ? grid.getOccupancy() :
+			                                               flatGrid.getOccupancy();
+			double s = cellGridTuner.evaluate(m);
+			if (s != m.cellSize) {
+				grid.setCellSize(s);
+				flatGrid.setCellSize(s);
+			}
+		}
+		if (cellModelCollisions && !models.empty() && modelBroadPhase == ModelBroadPhase::grid &&
+		    modelGridTuner.isDue(frame)) {
+			GridMeasure m;
+			m.cellSize = modelGrid.getCellSize();
+			m.nbQueries = nbModelQueries;
+			m.queryRadii = sampleRadii(cells, cellRadius);
+			for (auto &mod : models) {
+				// radius of a face = largest distance between its centroid and a vertex
+				const Model &md = mod.second;
+				auto faceRadius = [&](const Triangle &t) {
+					const auto &v = md.getVertices();
+					const Vec &a = v[t.indices[0]], &b = v[t.indices[1]], &c = v[t.indices[2]];
+					Vec center = (a + b + c) / 3.0;
+					return sqrt(max((a - center).sqlength(),
+					                max((b - center).sqlength(), (c - center).sqlength())));
+				};
+				auto r = sampleRadii(md.faces, faceRadius);
+				m.storedRadii.insert(m.storedRadii.end(), r.begin(), r.end());
+				m.nbStored += md.faces.size();
+			}
+			if (nbModelQueries > 0)
+				m.candidatesPerQuery = static_cast<double>(nbModelCandidates) / nbModelQueries;
+			m.occupancy = modelGrid.getOccupancy();
+			double s = modelGridTuner.evaluate(m);
+			if (s != m.cellSize) {
+				modelGrid.setCellSize(s);
+				for (auto &mod : models) insertInGrid(mod.second);
+			}
+		}
+	}
+
+	// fills modelCandidates with the (model, face) pairs that can touch the sphere (p, r),
+	// sorted & unique
+	void retrieveModelCandidates(const Vec &p, double r) {
+		if (modelBroadPhase == ModelBroadPhase::grid) {
+			modelGrid.retrieveUnique(p, r, modelCandidates);
+			return;
+		}
+		modelCandidates.clear();
+		for (const auto &b : modelBVHs) {
+			Model *m = b.first;
+			b.second.forEachTriangleNear(m->toModelSpace(p), r * m->getInverseStretch(),
+			                             [&](uint32_t f) { modelCandidates.push_back({m, f}); });
+		}
+		sort(modelCandidates.begin(), modelCandidates.end());
+	}
+
+	// key of the cell-model connections order
+	static pair<Cell *, Model *> modelConnectionKey(const modelConnect_type &c) {
+		return {c.bounce.getNode1(), c.model};
+	}
+	static bool modelConnectionLess(const modelConnect_type &a, const modelConnect_type &b) {
+		return modelConnectionKey(a) < modelConnectionKey(b);
+	}
+
+	// cells point to their model connections: to be called whenever cellModelConnections
+	// is modified
+	void refreshCellModelConnections() {
+		for (auto &c : cells) c->getRWModelConnections().clear();
+		for (auto &cmc : cellModelConnections) cmc.bounce.getNode1()->addModelConnection(&cmc);
+	}
+
+	// removes the connections for which pred is true, in one pass (order is kept)
+	template <typename P> void eraseModelConnections(P pred) {
+		size_t n = cellModelConnections.size();
+		cellModelConnections.erase(
+		    remove_if(cellModelConnections.begin(), cellModelConnections.end(), pred),
+		    cellModelConnections.end());
+		if (cellModelConnections.size() != n) refreshCellModelConnections();
+	}
+
+	// if conn goes in the same direction as currentDirection, it is moved to the new
+	// projection of c on face mf and true is returned
+	bool updateModelConnection(modelConnect_type &conn, Cell *c,
+	                           const pair<Model *, unsigned int> &mf, const Vec &projection,
+	                           const Vec &currentDirection) {
+		Vec prevDirection =
+		    (conn.bounce.getNode0().getPosition() - c->getPrevposition()).normalized();
+		MECACELL_TRACE("connection " << &conn << ": prevDir.dot(currentDir) = "
+		                             << prevDirection.dot(currentDirection));
+		if (prevDirection.dot(currentDirection) <= MIN_CONNECTION_SIMILARITY) return false;
+		conn.dirty = false;
+		// first, the bounce spring
+		conn.bounce.getNode0().position = projection;
+		conn.bounce.getNode0().face = mf.second;
+		MECACELL_TRACE("connection " << &conn << " updated");
+		// then the anchor. It's just another simple spring that is always at the
+		// same height as the cell (orthogonal to the bounce spring)
+		// it has a restlength of 0 and follows the cell when its length is more
+		// than the cell's radius;
+		if (conn.anchor.getSc().length > 0) {
+			// first we keep the anchor at cell height
+			const Vec &anchorDirection = conn.anchor.getSc().direction;
+			Vec crossp = currentDirection.cross(currentDirection.cross(anchorDirection));
+			if (crossp.sqlength() > c->getRadius() * 0.02) {
+				crossp.normalize();
+				MECACELL_TRACE("anchor at cell level, projection axis = " << crossp);
+				double projLength =
+				    min((conn.anchor.getNode0().getPosition() - c->getPosition()).dot(crossp),
+				        c->getRadius());
+				conn.anchor.getNode0().position = c->getPosition() + projLength * crossp;
 			}
 		}
+		return true;
+	}
+
+	void checkForCellModellCollisions() {
+		nbModelCandidates = nbModelQueries = 0;
+		// first, we set all connections to dirty
+		for (auto &cmc : cellModelConnections) cmc.dirty = true;
+		newModelConnections.clear();
 		for (auto &c : cells) {
+			const size_t firstNew = newModelConnections.size(); // created for c
 			// for each cell, we find if a cell - model collision is possible.
-			auto toTest = modelGrid.retrieveUnique(c->getPosition(), c->getRadius());
-			for (const auto &mf : toTest) {
-				cerr << GREY << "+----------------------------------------------------+" << NORMAL
-				     << endl;
-				cerr << " potential collision between cell " << c << " and model "
-				     << mf.first->name << endl;
+			retrieveModelCandidates(c->getPosition(), c->getRadius());
+			++nbModelQueries;
+			nbModelCandidates += modelCandidates.size();
+			for (const auto &mf : modelCandidates) {
 				// for each pair <model*, faceId> mf potentially colliding with c
-				const Vec &p0 = mf.first->vertices[mf.first->faces[mf.second].indices[0]];
-				const Vec &p1 = mf.first->vertices[mf.first->faces[mf.second].indices[1]];
-				const Vec &p2 = mf.first->vertices[mf.first->faces[mf.second].indices[2]];
+				const array<Vec, 3> tri = mf.first->getFaceVertices(mf.second);
+				const Vec &p0 = tri[0], &p1 = tri[1], &p2 = tri[2];
 				// checking if cell c is in contact with triangle p0, p1, p2
 				pair<bool, Vec> projec = projectionIntriangle(p0, p1, p2, c->getPosition());
 				// projec = {projection inside triangle, projection coordinates}
 				// TODO: we also need to check if the connection should be on a vertice
 
 				Vec currentDirection = projec.second - c->getPosition();
-				cerr << " projec = {" << projec.first << ", " << projec.second << "}" << endl;
+				MECACELL_TRACE("cell " << c << " / model " << mf.first->name << " face "
+				                       << mf.second << ": projection = {" << projec.first << ", "
+				                       << projec.second << "}");
 				if (projec.first && currentDirection.sqlength() < pow(c->getRadius(), 2)) {
 					// we have a potential connection. Now we consider 2 cases:
 					// 1 - brand new connection (easy)
@@ -260,59 +637,31 @@ public:
 					//  => same cell/model pair + similar bounce angle (same face or similar normal)
 					currentDirection.normalize();
 					bool alreadyExist = false;
-					cerr << CYAN << " collision !" << NORMAL << endl;
-					if (cellModelConnections.count(mf.first) &&
-					    cellModelConnections[mf.first].count(c)) {
-						cerr << " there already is a connection between this cell and this model. "
-						     << endl;
-						for (auto &otherconn : cellModelConnections[mf.first][c]) {
-							Vec prevDirection =
-							    (otherconn->bounce.getNode0().getPosition() - c->getPrevposition())
-							        .normalized();
-							cerr << " prevDir.dot(currentDir) = " << prevDirection.dot(currentDirection)
-							     << endl;
-							if (prevDirection.dot(currentDirection) > MIN_CONNECTION_SIMILARITY) {
-								alreadyExist = true;
-								cerr << GREEN << " Yep, it's an old connection (" << otherconn.get()
-								     << ")" << endl;
-								otherconn->dirty = false;
-								// case n° 2, we want to update otherconn
-								// first, the bounce spring
-								otherconn->bounce.getNode0().position = projec.second;
-								otherconn->bounce.getNode0().face = mf.second;
-								cerr << " bounce spring updated" << endl;
-								// then the anchor. It's just another simple spring that is always at the
-								// same height as the cell (orthogonal to the bounce spring)
-								// it has a restlength of 0 and follows the cell when its length is more
-								// than the cell's radius;
-								if (otherconn->anchor.getSc().length > 0) {
-									cerr << " putting anchor at cell level" << endl;
-									// first we keep the anchor at cell height
-									const Vec &anchorDirection = otherconn->anchor.getSc().direction;
-									Vec crossp =
-									    currentDirection.cross(currentDirection.cross(anchorDirection));
-									if (crossp.sqlength() > c->getRadius() * 0.02) {
-										crossp.normalize();
-										cerr << " projection axis = " << crossp << endl;
-										double projLength = min(
-										    (otherconn->anchor.getNode0().getPosition() - c->getPosition())
-										        .dot(crossp),
-										    c->getRadius());
-										otherconn->anchor.getNode0().position =
-										    c->getPosition() + projLength * crossp;
-									}
-								}
-								break;
-							}
-						}
-					}
+					MECACELL_TRACE("collision between cell " << c << " and model " << mf.first->name);
+					// older connections of this cell & model: a binary search among the sorted
+					// ones, then the ones created during this pass
+					const pair<Cell *, Model *> key(c, mf.first);
+					auto it = lower_bound(
+					    cellModelConnections.begin(), cellModelConnections.end(), key,
+					    [](const modelConnect_type &a, const pair<Cell *, Model *> &k) {
+						    return modelConnectionKey(a) < k;
+						  });
+					for (; !alreadyExist && it != cellModelConnections.end() &&
+					       modelConnectionKey(*it) == key;
+					     ++it)
+						alreadyExist = updateModelConnection(*it, c, mf, projec.second, currentDirection);
+					for (size_t i = firstNew; !alreadyExist && i < newModelConnections.size(); ++i)
+						if (newModelConnections[i].model == mf.first)
+							alreadyExist = updateModelConnection(newModelConnections[i], c, mf,
+							                                     projec.second, currentDirection);
 					if (!alreadyExist) {
 						// new connection
-						cerr << BLUE << " it's a new connection" << endl;
+						MECACELL_TRACE("new connection between cell " << c << " and model "
+						                                              << mf.first->name);
 						double adh = c->getAdhesionWithModel(mf.first->name);
 						double l = mix(MAX_CELL_ADH_LENGTH * c->getRadius(),
 						               MIN_CELL_ADH_LENGTH * c->getRadius(), adh);
-						unique_ptr<CellModelConnection<Cell>> cmc(new CellModelConnection<Cell>(
+						newModelConnections.push_back(modelConnect_type(
 						    Connection<SpaceConnectionPoint, Cell *>(
 						        {SpaceConnectionPoint(c->getPosition()), c}, // N0, N1
 						        Spring(100, dampingFromRatio(0.9, c->getMass(), 100),
@@ -325,60 +674,111 @@ public:
 						                                c->getStiffness() * 1.0),
 						               l) // bounce
 						        )));
-						cmc->anchor.tjEnabled = false;
+						newModelConnections.back().anchor.tjEnabled = false;
 						// cmc->anchor.getFlex().first.targetUpdateEnabled = false;
 						// cmc->anchor.getFlex().first.target = -currentDirection;
-						c->addModelConnection(cmc.get());
-						cellModelConnections[mf.first][c].push_back(move(cmc));
 					}
 				}
-				cerr << PURPLE << "|___________________________________________|" << NORMAL
-				     << endl
-				     << endl;
 			}
 		}
-		// clean up: dirty connections
-		for (auto &m : cellModelConnections) {
-			for (auto &c : m.second) {
-				for (auto it = c.second.begin(); it != c.second.end();) {
-					if ((*it)->dirty) {
-						cerr << " deleting dirty connection " << endl;
-						c.first->removeModelConnection(it->get());
-						it = c.second.erase(it);
-					} else {
-						++it;
-					}
-				}
-			}
+		// clean up: dirty connections are removed and the new ones merged in, keeping the
+		// (cell, model) order (older connections first for a same pair)
+		const size_t nbBefore = cellModelConnections.size();
+		cellModelConnections.erase(remove_if(cellModelConnections.begin(),
+		                                     cellModelConnections.end(),
+		                                     [](const modelConnect_type &cmc) {
+			                                     if (cmc.dirty)
+				                                     MECACELL_TRACE("deleting connection " << &cmc);
+			                                     return cmc.dirty;
+			                                   }),
+		                           cellModelConnections.end());
+		if (!newModelConnections.empty()) {
+			stable_sort(newModelConnections.begin(), newModelConnections.end(),
+			            modelConnectionLess);
+			const size_t mid = cellModelConnections.size();
+			cellModelConnections.insert(cellModelConnections.end(), newModelConnections.begin(),
+			                            newModelConnections.end());
+			inplace_merge(cellModelConnections.begin(), cellModelConnections.begin() + mid,
+			              cellModelConnections.end(), modelConnectionLess);
 		}
-		// clean up: empty entries
-		for (auto itM = cellModelConnections.begin(); itM != cellModelConnections.end();) {
-			if (itM->second.empty()) {
-				itM = cellModelConnections.erase(itM);
-			} else {
-				for (auto itC = itM->second.begin(); itC != itM->second.end();) {
-					if (itC->second.empty()) {
-						itC = itM->second.erase(itC);
-					} else {
-						++itC;
-					}
+		if (cellModelConnections.size() != nbBefore || !newModelConnections.empty())
+			refreshCellModelConnections();
+	}
+
+	void updateCellGrid() {
+		if (useNeighbourLists) {
+			neighbourLists.update(cells);
+			return;
+		}
+		switch (broadPhase) {
+			case BroadPhase::flatGrid:
+				flatGrid.clear();
+				for (const auto &c : cells) flatGrid.insert(c);
+				flatGrid.build();
+				break;
+			case BroadPhase::cellList:
+				cellList.build(cells, threadPool);
+				break;
+			case BroadPhase::multiLevel:
+				multiLevelGrid.build(cells, threadPool);
+				break;
+			default:
+				if (incrementalGrid) {
+					grid.update(cells);
+				} else {
+					grid.clear();
+					for (const auto &c : cells) grid.insert(c);
 				}
-				++itM;
-			}
 		}
 	}
 
 	void cellCollisions() {
+		if (useNeighbourLists) {
+			size_t prevNbConnections = connections.size();
+			neighbourLists.forEachPair(
+			    [&](Cell *c0, Cell *c1) { c0->connection(c1, connections, connectionPool); });
+			addToColouring(prevNbConnections);
+			return;
+		}
+		switch (broadPhase) {
+			case BroadPhase::flatGrid:
+				cellCollisions(flatGrid);
+				break;
+			case BroadPhase::cellList: {
+				size_t prevNbConnections = connections.size();
+				cellList.forEachPair(
+				    [&](Cell *c0, Cell *c1) { c0->connection(c1, connections, connectionPool); });
+				addToColouring(prevNbConnections);
+			} break;
+			case BroadPhase::multiLevel: {
+				size_t prevNbConnections = connections.size();
+				multiLevelGrid.forEachPair(
+				    [&](Cell *c0, Cell *c1) { c0->connection(c1, connections, connectionPool); });
+				addToColouring(prevNbConnections);
+			} break;
+			default:
+				cellCollisions(grid);
+		}
+	}
+
+	// tests each cell against the candidates found in g, each pair once (see
+	// Grid::forEachPairOf)
+	template <typename G> void cellCollisions(const G &g) {
+		size_t prevNbConnections = connections.size();
+		nbCellCandidates = nbCellQueries = 0;
 		for (auto &c : cells) {
-			vector<Cell *> toTest = grid.retrieve(c);
-			connect_type *s = nullptr;
-			for (const auto &c2 : toTest) {
-				if (!c2->alreadyTested()) {
-					c->connection(c2, connections);
-				}
-			}
-			c->markAsTested();
+			++nbCellQueries;
+			nbCellCandidates += g.forEachPairOf(
+			    c, [&](Cell *c0, Cell *c1) { c0->connection(c1, connections, connectionPool); });
 		}
+		addToColouring(prevNbConnections);
+	}
+
+	// connections created since connections had size prevNbConnections
+	void addToColouring(size_t prevNbConnections) {
+		if (forceAssembly == ForceAssembly::coloured)
+			for (size_t i = prevNbConnections; i < connections.size(); ++i)
+				colouring.add(connections[i]);
 	}
 
 	void deleteImpossibleConnections() {
@@ -387,8 +787,9 @@ public:
 		    remove_if(connections.begin(), connections.end(), [&](connect_type *c) {
 			    double maxL = c->getNode0()->getRadius() + c->getNode1()->getRadius();
 			    if (c->getLength() > maxL) {
+				    colouring.remove(c);
 				    c->getNode0()->removeConnection(c->getNode1(), c);
-				    delete c;
+				    connectionPool.destroy(c);
 				    return true;
 			    }
 			    return false;
@@ -449,7 +850,8 @@ public:
 							other1->eraseCell(cell);
 							connections.erase(remove(connections.begin(), connections.end(), c1),
 							                  connections.end());
-							delete c1;
+							colouring.remove(c1);
+							connectionPool.destroy(c1);
 						} else if (scal10 > 0 && c1SqLength < c0SqLength &&
 						           (c1SqLength - scal10 * scal10) < r1 * r1 * overlapCoef) {
 							c0It = vec.erase(c0It);
@@ -459,7 +861,8 @@ public:
 							connections.erase(remove(connections.begin(), connections.end(), c0),
 							                  connections.end());
 							deleted = true;
-							delete c0;
+							colouring.remove(c0);
+							connectionPool.destroy(c0);
 							break; // we need to exit the inner loop, c0 doesn't exist
 							       // anymore.
 						} else {
@@ -483,36 +886,177 @@ public:
 	~BasicWorld() {
 		destroyCells();
 		while (!cells.empty())
-			delete cells.back(), cells.pop_back();
+			deleteCell(cells.back()), cells.pop_back();
 		while (!connections.empty())
-			delete connections.back(), connections.pop_back();
+			connectionPool.destroy(connections.back()), connections.pop_back();
 	}
 
 	void disableCellCellCollisions() { cellCellCollisions = false; }
 
 	int getNbUpdates() const { return frame; }
 
+	// allocates a cell from the world's pool and adds it
+	template <typename... Args> Cell *newCell(Args &&... args) {
+		Cell *c = cellPool.create(std::forward<Args>(args)...);
+		c->markAsPooled();
+		addCell(c);
+		return c;
+	}
+
+	void deleteCell(Cell *c) {
+		neighbourLists.invalidate();
+		c->unbindKinematicStore();
+		if (c->isPooled())
+			c->getCellPool()->destroy(c);
+		else
+			delete c;
+	}
+
 	void addCell(Cell *c) {
-		if (c != NULL) cells.push_back(c);
+		if (c != NULL) {
+			neighbourLists.invalidate();
+			if (!c->getCellPool()) c->setCellPool(&cellPool);
+			cells.push_back(c);
+			if (structureOfArrays) {
+				kinematics.resize(cells.size());
+				c->bindKinematicStore(&kinematics, cells.size() - 1);
+			}
+		}
 	}
 
-	void destroyCells() {
-		for (auto i = cells.begin(); i != cells.end();) {
-			if ((*i)->isDead()) {
-				auto c = *i;
-				c->eraseAndDeleteAllConnections(connections);
-				for (auto &m : models) {
-					if (cellModelConnections.count(&m.second) &&
-					    cellModelConnections.at(&m.second).count(c)) {
-						cellModelConnections.at(&m.second).erase(c);
-					}
+	// mean distance in the cells vector between two connected cells (lower is better)
+	double computeLocality() {
+		if (connections.empty()) return 0.0;
+		indexCells();
+		double sum = 0;
+		for (const auto &con : connections) {
+			size_t i0 = getCellIndex(con->getNode0()), i1 = getCellIndex(con->getNode1());
+			sum += i0 > i1 ? i0 - i1 : i1 - i0;
+		}
+		return sum / static_cast<double>(connections.size());
+	}
+
+	void reorderCells() {
+		if (cells.empty()) return;
+		double meanRadius = 0;
+		for (const auto &c : cells) meanRadius += c->getRadius();
+		reorderList.setCellSize(meanRadius / static_cast<double>(cells.size()));
+		reorderList.build(cells, threadPool);
+		cells.assign(reorderList.getSortedOrder().begin(), reorderList.getSortedOrder().end());
+		reorderList.clear();
+		if (structureOfArrays) compactKinematics();
+		indexCells();
+		vector<pair<pair<size_t, size_t>, connect_type *>> keyed;
+		keyed.reserve(connections.size());
+		for (const auto &con : connections)
+			keyed.push_back(
+			    {{getCellIndex(con->getNode0()), getCellIndex(con->getNode1())}, con});
+		sort(keyed.begin(), keyed.end(),
+		     [](const pair<pair<size_t, size_t>, connect_type *> &a,
+		        const pair<pair<size_t, size_t>, connect_type *> &b) { return a.first < b.first; });
+		for (size_t i = 0; i < keyed.size(); ++i) connections[i] = keyed[i].second;
+		relocateConnections();
+		neighbourLists.invalidate(); // its lists follow the order of cells
+		++nbReorderings;
+		locality = localityAfterReorder = computeLocality();
+	}
+
+	// Permutes the connections between the pool slots they occupy, so that the i-th
+	// connection of the connections vector gets the i-th lowest address and iterating over
+	// it walks through memory in order. Connections are moved along the cycles of the
+	// permutation (one temporary connection, no extra slot), then the connections lists
+	// of the cells are updated.
+	void relocateConnections() {
+		vector<connect_type *> slots(connections);
+		sort(slots.begin(), slots.end());
+		auto slotIndex = [&](connect_type *c) {
+			return lower_bound(slots.begin(), slots.end(), c) - slots.begin();
+		};
+		// slot i receives connections[i]
+		vector<bool> done(slots.size(), false);
+		for (size_t start = 0; start < slots.size(); ++start) {
+			if (done[start] || connections[start] == slots[start]) continue;
+			connect_type first = *slots[start];
+			size_t i = start;
+			for (;;) {
+				done[i] = true;
+				size_t from = slotIndex(connections[i]);
+				if (from == start) {
+					*slots[i] = first;
+					break;
 				}
-				i = cells.erase(i);
-				delete c;
-			} else {
-				++i;
+				*slots[i] = *connections[i];
+				i = from;
 			}
 		}
+		vector<pair<connect_type *, connect_type *>> moved(connections.size()); // old, new
+		for (size_t i = 0; i < connections.size(); ++i) moved[i] = {connections[i], slots[i]};
+		sort(moved.begin(), moved.end());
+		connections.swap(slots);
+		auto newAddress = [&](connect_type *c) {
+			return lower_bound(moved.begin(), moved.end(), make_pair(c, (connect_type *)nullptr))
+			    ->second;
+		};
+		for (auto &c : cells)
+			for (auto &con : c->getRWConnections()) con = newAddress(con);
+		if (forceAssembly == ForceAssembly::coloured) colouring.rebuild(connections);
+	}
+
+	// fills cellIndices, for getCellIndex
+	void indexCells() {
+		cellIndices.resize(cells.size());
+		for (size_t i = 0; i < cells.size(); ++i) cellIndices[i] = {cells[i], i};
+		sort(cellIndices.begin(), cellIndices.end());
+	}
+	size_t getCellIndex(Cell *c) const {
+		return lower_bound(cellIndices.begin(), cellIndices.end(), make_pair(c, size_t(0)))
+		    ->second;
+	}
+
+	// brings the kinematic store back in the same order as the cells vector
+	void compactKinematics() {
+		vector<size_t> from(cells.size());
+		for (size_t i = 0; i < cells.size(); ++i) from[i] = cells[i]->getKinematicId();
+		kinematicsBuffer.gather(kinematics, from);
+		kinematics.swap(kinematicsBuffer);
+		for (size_t i = 0; i < cells.size(); ++i) cells[i]->rebindKinematicStore(i);
+	}
+
+	// removes dead cells in linear time: one pass over the connections, then one over
+	// the cells
+	void destroyCells() {
+		if (none_of(cells.begin(), cells.end(), [](Cell *c) { return c->isDead(); })) return;
+		eraseModelConnections(
+		    [](const modelConnect_type &cmc) { return cmc.bounce.getNode1()->isDead(); });
+		connections.erase(
+		    remove_if(connections.begin(), connections.end(), [&](connect_type *con) {
+			    Cell *c0 = con->getNode0();
+			    Cell *c1 = con->getNode1();
+			    bool dead0 = c0->isDead();
+			    bool dead1 = c1->isDead();
+			    if (!dead0 && !dead1) return false;
+			    // only survivors need to forget about the connection
+			    if (!dead0) {
+				    c0->eraseConnection(con);
+				    c0->eraseCell(c1);
+			    }
+			    if (!dead1) {
+				    c1->eraseConnection(con);
+				    c1->eraseCell(c0);
+			    }
+			    colouring.remove(con);
+			    connectionPool.destroy(con);
+			    return true;
+			  }),
+		    connections.end());
+		cells.erase(remove_if(cells.begin(), cells.end(),
+		                      [&](Cell *c) {
+			                      if (!c->isDead()) return false;
+			                      deleteCell(c);
+			                      return true;
+			                    }),
+		            cells.end());
+		if (structureOfArrays) compactKinematics();
 	}
 
 	void reset() {
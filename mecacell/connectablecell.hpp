@@ -15,6 +15,8 @@
 #include "connection.h"
 #include "modelconnection.hpp"
 #include "model.h"
+#include "objectpool.hpp"
+#include "flatset.hpp"
 
 #define CUBICROOT2 1.25992104989
 #define VOLUMEPI 0.23873241463 // 1/(4/3*pi)
@@ -36,16 +38,30 @@ protected:
 	bool tested = false; // has already been tested for collision
 	vector<ConnectionType *> connections;
 	vector<ModelConnectionType *> modelConnections;
-	vector<Derived *> connectedCells; // TODO: try with an unordered_set (easier check for
-	                                  // already connected)
+	FlatSet<Derived *> connectedCells; // sorted, for O(log k) "already connected" checks
 	double pressure = 1.0;
 	bool visible = true;
+	// pool used by divide(), and whether this cell was itself allocated from it
+	ObjectPool<Derived> *cellPool = nullptr;
+	bool pooled = false;
+
+	template <typename C> C *allocateDaughter(const Vec &translation, std::false_type) {
+		return new C(selfconst(), translation);
+	}
+	template <typename C> C *allocateDaughter(const Vec &translation, std::true_type) {
+		if (!cellPool) return new C(selfconst(), translation);
+		// close to its mother in memory, when she comes from the same pool
+		C *c = cellPool->createNear(pooled ? selfptr() : nullptr, selfconst(), translation);
+		c->setCellPool(cellPool);
+		c->markAsPooled();
+		return c;
+	}
 
 public:
 	ConnectableCell(Vec pos) : Movable(pos) { randomColor(); }
 
 	ConnectableCell(const Derived &c, const Vec &translation)
-	    : Movable(c.getPosition() + translation, c.mass),
+	    : Movable(c.getPosition() + translation, c.getMass()),
 	      dead(false),
 	      color(c.color),
 	      radius(c.radius),
@@ -62,13 +78,16 @@ public:
 		if (i < 3) return color[i];
 		return 0;
 	}
-	const std::vector<Derived *> &getConnectedCells() const { return connectedCells; }
+	const std::vector<Derived *> &getConnectedCells() const {
+		return connectedCells.getVector();
+	}
+	bool isConnectedTo(Derived *c) const { return connectedCells.count(c) > 0; }
 
 	double getPressure() const { return pressure; }
 
 	void computePressure() {
 		double surface = 4.0 * M_PI * radius * radius;
-		pressure = totalForce / surface;
+		pressure = getTotalForce() / surface;
 	}
 
 	double getNormalizedPressure() const {
@@ -80,13 +99,34 @@ public:
 	bool alreadyTested() const { return tested; }
 	int getNbConnections() const { return connections.size(); }
 
+	// moves the kinematic state into element id of a world owned store
+	void bindKinematicStore(KinematicStore *s, size_t id) {
+		bindKinematics(s, id);
+		bindOrientationKinematics(s, id);
+		s->momentOfInertia[id] = getMomentOfInertia();
+	}
+	void rebindKinematicStore(size_t id) {
+		rebindKinematics(id);
+		rebindOrientationKinematics(id);
+	}
+	void unbindKinematicStore() {
+		unbindKinematics();
+		unbindOrientationKinematics();
+	}
+
+	ObjectPool<Derived> *getCellPool() const { return cellPool; }
+	void setCellPool(ObjectPool<Derived> *p) { cellPool = p; }
+	bool isPooled() const { return pooled; }
+	void markAsPooled() { pooled = true; }
+
 	void setVisible(bool v) { visible = v; }
 	bool getVisible() { return visible; }
 	string toString() {
 		stringstream s;
 		s << "Cell " << this << " :" << endl;
-		s << " position = " << position << ", orientation = " << orientation << endl;
-		s << " velocity = " << velocity << ", angular velocity = " << angularVelocity << endl;
+		s << " position = " << getPosition() << ", orientation = " << getOrientation() << endl;
+		s << " velocity = " << getVelocity() << ", angular velocity = " << getAngularVelocity()
+		  << endl;
 		s << " radius = " << radius << " (base = " << baseRadius << ")" << endl;
 		s << " stiffness = " << stiffness << " (angular = " << angularStiffness << ")"
 		  << endl;
@@ -148,23 +188,25 @@ public:
 	/******************************
 	 * connections
 	 *****************************/
-	void connection(Derived *c, vector<ConnectionType *> &worldConnexions) {
+	// alloc is used to create the connection: it must be the one the world destroys its
+	// connections with (BasicWorld::connectionPool)
+	template <typename Alloc>
+	void connection(Derived *c, vector<ConnectionType *> &worldConnexions, Alloc &alloc) {
 		if (c != this) {
-			Vec AB = c->position - position;
+			Vec AB = c->getPosition() - getPosition();
 			double sqdist = AB.sqlength();
 			double sql = radius + c->radius;
 			sql *= sql;
 			// interpenetration
 			if (sqdist <= sql) {
-				if (find(connectedCells.begin(), connectedCells.end(), c) ==
-				    connectedCells.end()) {
+				if (!isConnectedTo(c)) {
 					// if those cells aren't already connected
 					// we check if this connection would not go through an already connected cell
 					bool ok = true;
 					for (auto &con : connections) {
 						Derived *otherCell =
 						    con->getNode0() == selfptr() ? con->getNode1() : con->getNode0();
-						Vec AO = otherCell->getPosition() - position;
+						Vec AO = otherCell->getPosition() - getPosition();
 						double AOdotAB = AO.dot(AB);
 						if (AOdotAB > 0) {
 							// Other cell's projection onto AB
@@ -192,9 +234,9 @@ public:
 						    (dampRatio * radius + c->dampRatio * c->radius) / (radius + c->radius);
 						// double maxTeta = mix(0.0, M_PI / 2.0, minAdh);
 						double maxTeta = M_PI / 12.0;
-						ConnectionType *s = new ConnectionType(
+						ConnectionType *s = alloc.create(
 						    pair<Derived *, Derived *>(selfptr(), c),
-						    Spring(k, dampingFromRatio(dr, mass + c->mass, k), l),
+						    Spring(k, dampingFromRatio(dr, getMass() + c->getMass(), k), l),
 						    make_pair(Joint(getAngularStiffness(),
 						                    dampingFromRatio(dr, getMomentOfInertia() * 2.0,
 						                                     angularStiffness),
@@ -225,7 +267,7 @@ public:
 		}
 	}
 
-	double getMomentOfInertia() const { return 4.0 * mass * radius * radius; }
+	double getMomentOfInertia() const { return 4.0 * getMass() * radius * radius; }
 	double getAngularStiffness() const { return angularStiffness; }
 
 	// recomputes all connections sizes according to the the current size of the cell
@@ -248,7 +290,8 @@ public:
 		setRadius(getBaseRadius());
 		setMass(getBaseMass());
 		updateAllConnections();
-		C *newC = new C(selfconst(), direction.normalized() * radius * 0.8);
+		C *newC = allocateDaughter<C>(direction.normalized() * radius * 0.8,
+		                              typename std::is_same<C, Derived>::type());
 		return newC;
 	}
 
@@ -262,15 +305,14 @@ public:
 	void addConnection(Derived *c, ConnectionType *s) {
 		connections.push_back(s);
 		c->connections.push_back(s);
-		connectedCells.push_back(c);
-		c->connectedCells.push_back(selfptr());
+		connectedCells.insert(c);
+		c->connectedCells.insert(selfptr());
 	}
 
 	// erase cell from the connectedCells container
 	void eraseCell(Derived *cell) {
 		unsigned int prevC = connectedCells.size();
-		connectedCells.erase(remove(connectedCells.begin(), connectedCells.end(), cell),
-		                     connectedCells.end());
+		connectedCells.erase(cell);
 		assert(connectedCells.size() == prevC - 1 || prevC == 0);
 	}
 
@@ -299,26 +341,25 @@ public:
 	}
 
 	// erase connection s f the connections container
+	// connections keep their creation order (it is the force gathering order)
 	void eraseConnection(ConnectionType *s) {
-		connections.erase(remove(connections.begin(), connections.end(), s),
-		                  connections.end());
+		auto it = find(connections.begin(), connections.end(), s);
+		if (it != connections.end()) connections.erase(it);
 	}
 
-	void eraseAndDeleteAllConnections(std::vector<ConnectionType *> &aux) {
+	// alloc must be the allocator the connections were created with
+	template <typename Alloc>
+	void eraseAndDeleteAllConnections(std::vector<ConnectionType *> &aux, Alloc &alloc) {
 		for (auto cIt = connections.begin(); cIt != connections.end();) {
 			ConnectionType *sp = *cIt;
 			auto otherCell = sp->getNode0() == this ? sp->getNode1() : sp->getNode0();
 			if (otherCell != nullptr) {
 				aux.erase(remove(aux.begin(), aux.end(), sp), aux.end());
-				connectedCells.erase(
-				    remove(connectedCells.begin(), connectedCells.end(), otherCell),
-				    connectedCells.end());
-				otherCell->connectedCells.erase(remove(otherCell->connectedCells.begin(),
-				                                       otherCell->connectedCells.end(), this),
-				                                otherCell->connectedCells.end());
+				connectedCells.erase(otherCell);
+				otherCell->connectedCells.erase(selfptr());
 				otherCell->eraseConnection(sp);
 				cIt = connections.erase(cIt);
-				delete sp;
+				alloc.destroy(sp);
 			} else {
 				++cIt;
 			}
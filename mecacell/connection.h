@@ -59,6 +59,41 @@ struct Joint {
 	void setCurrentKCoef(double kc) { currentK = k * kc; }
 };
 
+////////////////////////////////////////////////////////////////////
+//                    NODE CONTRIBUTION
+////////////////////////////////////////////////////////////////////
+// What a connection did to one of its nodes during a deferred computeForces.
+// Position and velocity corrections come from the minLengthRatio enforcement and are
+// expressed as deltas, so that contributions of several connections can be summed.
+struct NodeContribution {
+	Vec force = Vec::zero();
+	Vec torque = Vec::zero();
+	Vec positionCorrection = Vec::zero();
+	Vec velocityCorrection = Vec::zero();
+	double totalForce = 0; // signed intensity (compressive > 0), used for pressure
+	bool corrected = false;
+
+	void reset() {
+		force = Vec::zero();
+		torque = Vec::zero();
+		totalForce = 0;
+		if (corrected) {
+			positionCorrection = Vec::zero();
+			velocityCorrection = Vec::zero();
+			corrected = false;
+		}
+	}
+	template <typename N> void applyTo(N &node) const {
+		node.receiveForce(force);
+		node.receiveTotalForce(totalForce);
+		node.receiveTorque(torque);
+		if (corrected) {
+			node.setPosition(node.getPosition() + positionCorrection);
+			node.setVelocity(node.getVelocity() + velocityCorrection);
+		}
+	}
+};
+
 ////////////////////////////////////////////////////////////////////
 //                      CONNECTION CLASS
 ////////////////////////////////////////////////////////////////////
@@ -77,14 +112,49 @@ struct Joint {
 // - double getInertia()
 // - void receiveForce(double intensity, Vec direction, bool compressive)
 // - void receiveTorque(Vec acc)
+// computeForces<true> is the deferred version: nodes are only read and what would have
+// been applied to them is stored in a caller-owned pair of NodeContribution (one per
+// node), which makes it safe to compute connections sharing a node concurrently.
+// The caller can remember where that pair is with setContributionId.
 template <typename N0, typename N1 = N0> class Connection {
 private:
 	pair<N0, N1> connected;    // the two connected nodes
 	Spring sc;                 // basic spring
 	pair<Joint, Joint> fj, tj; // flexure and torsion joints (1 per node)
 
+	template <bool Deferred, int n>
+	void sendForce(NodeContribution *contributions, const double &intensity,
+	               const Vec &direction, const bool &compressive) {
+		if (Deferred) {
+			contributions[n].force += direction * intensity;
+			contributions[n].totalForce += compressive ? intensity : -intensity;
+		} else {
+			ptr(get<n>(connected))->receiveForce(intensity, direction, compressive);
+		}
+	}
+	template <bool Deferred, int n>
+	void sendForce(NodeContribution *contributions, const Vec &f) {
+		if (Deferred)
+			contributions[n].force += f;
+		else
+			ptr(get<n>(connected))->receiveForce(f);
+	}
+	template <bool Deferred, int n>
+	void sendTorque(NodeContribution *contributions, const Vec &t) {
+		if (Deferred)
+			contributions[n].torque += t;
+		else
+			ptr(get<n>(connected))->receiveTorque(t);
+	}
+
 public:
 	bool scEnabled = true, fjEnabled = true, tjEnabled = false;
+
+private:
+	// fits in the padding after the flags, so it does not grow the connection
+	unsigned int contributionId = 0;
+
+public:
 	/**********************************************
 	 *               CONSTRUCTOR
 	 **********************************************/
@@ -139,6 +209,14 @@ public:
 	pair<Joint, Joint> &getTorsion() { return tj; }
 	N0 &getNode0() { return connected.first; }
 	N1 &getNode1() { return connected.second; }
+	const N0 &getNode0() const { return connected.first; }
+	const N1 &getNode1() const { return connected.second; }
+	unsigned int getContributionId() const { return contributionId; }
+	void setContributionId(unsigned int i) { contributionId = i; }
+	// index of n's contribution in the pair filled by computeForces<true>
+	template <typename T> int getNodeIndex(const T &n) const {
+		return n == connected.first ? 0 : 1;
+	}
 	float getLength() { return sc.length; }
 	void setBaseLength(const double d) { sc.l = d; }
 	Vec getDirection() { return sc.direction; }
@@ -153,7 +231,13 @@ public:
 		sc.updateLengthDirection(ptr(connected.first)->getPosition(),
 		                         ptr(connected.second)->getPosition());
 	}
-	void computeForces(double dt) {
+	// contributions: the pair of NodeContribution filled when Deferred
+	template <bool Deferred = false>
+	void computeForces(double dt, NodeContribution *contributions = nullptr) {
+		if (Deferred) {
+			contributions[0].reset();
+			contributions[1].reset();
+		}
 		// BASIC SPRING
 		sc.updateLengthDirection(ptr(connected.first)->getPosition(),
 		                         ptr(connected.second)->getPosition());
@@ -168,20 +252,30 @@ public:
 				Vec component1 =
 				    ptr(connected.second)->getVelocity().dot(sc.direction) * sc.direction;
 				Vec tangent1 = ptr(connected.second)->getVelocity() - component1;
-				ptr(connected.first)
-				    ->setPosition(ptr(connected.first)->getPosition() - sc.direction * d / 2.0);
-				ptr(connected.second)
-				    ->setPosition(ptr(connected.second)->getPosition() + sc.direction * d / 2.0);
-				ptr(connected.first)->setVelocity(tangent0 + component1);
-				ptr(connected.second)->setVelocity(tangent1 + component0);
+				if (Deferred) {
+					// both nodes are pushed apart and exchange their normal velocities
+					contributions[0].positionCorrection += -sc.direction * d / 2.0;
+					contributions[1].positionCorrection += sc.direction * d / 2.0;
+					contributions[0].velocityCorrection += component1 - component0;
+					contributions[1].velocityCorrection += component0 - component1;
+					contributions[0].corrected = true;
+					contributions[1].corrected = true;
+				} else {
+					ptr(connected.first)
+					    ->setPosition(ptr(connected.first)->getPosition() - sc.direction * d / 2.0);
+					ptr(connected.second)
+					    ->setPosition(ptr(connected.second)->getPosition() + sc.direction * d / 2.0);
+					ptr(connected.first)->setVelocity(tangent0 + component1);
+					ptr(connected.second)->setVelocity(tangent1 + component0);
+				}
 				sc.length = minlength;
 			}
 			bool compression = x < 0;
 			double v = sc.length - sc.prevLength;
 			double k = sc.k; // compression ? sc.k : sc.k * 0.2;
 			double f = (-k * x - sc.c * v / dt) / 2.0;
-			ptr(connected.first)->receiveForce(f, -sc.direction, compression);
-			ptr(connected.second)->receiveForce(f, sc.direction, compression);
+			sendForce<Deferred, 0>(contributions, f, -sc.direction, compression);
+			sendForce<Deferred, 1>(contributions, f, sc.direction, compression);
 			sc.prevLength = sc.length;
 		}
 		// update directions of both flex and tosion springs
@@ -198,17 +292,16 @@ public:
 			                          ptr(connected.second)->getOrientationRotation());
 		}
 		if (tjEnabled || fjEnabled) {
-			updateFT<0>();
-			updateFT<1>();
+			updateFT<Deferred, 0>(contributions);
+			updateFT<Deferred, 1>(contributions);
 		}
 	}
 
-	template <int n> void updateFT() {
+	template <bool Deferred, int n> void updateFT(NodeContribution *contributions) {
 		Joint &tjNode = n == 0 ? tj.first : tj.second;
 		Joint &tjOther = n == 0 ? tj.second : tj.first;
 		Joint &fjNode = n == 0 ? fj.first : fj.second;
 		const auto &node = ptr(get<n>(connected));
-		const auto &other = ptr(get < n == 0 ? 1 : 0 > (connected));
 		const double sign = n == 0 ? 1 : -1;
 
 		if (fjEnabled) {
@@ -234,10 +327,10 @@ public:
 			Vec ortho = sc.direction.ortho(fjNode.delta.n).normalized(); // force direction
 			Vec force = sign * ortho * torque / d;
 
-			node->receiveForce(-force);
-			other->receiveForce(force);
+			sendForce<Deferred, n>(contributions, -force);
+			sendForce<Deferred, n == 0 ? 1 : 0>(contributions, force);
 
-			node->receiveTorque(vFlex);
+			sendTorque<Deferred, n>(contributions, vFlex);
 			fjNode.prevDelta = fjNode.delta;
 		}
 		if (tjEnabled) {
@@ -263,7 +356,7 @@ public:
 			    tjNode.delta
 			        .teta; // - tjNode.c * node->getAngularVelocity().dot(tjNode.delta.teta.n)
 			Vec vTorsion = torque * tjNode.delta.n;
-			node->receiveTorque(vTorsion);
+			sendTorque<Deferred, n>(contributions, vTorsion);
 		}
 	}
 };
@@ -0,0 +1,118 @@
+#ifndef MECACELL_CONNECTIONCOLOURING_HPP
+#define MECACELL_CONNECTIONCOLOURING_HPP
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+using namespace std;
+namespace MecaCell {
+// Edge colouring of the cell-cell connection graph: no two connections of the same colour
+// (batch) share a node, so all the connections of a batch can apply their forces to
+// their nodes concurrently. It is maintained incrementally: a new connection takes the
+// first colour not used by the other connections of its two nodes (greedy, so at most
+// 2 * maxDegree - 1 colours), a removed one is swapped out of its batch. Removals leave
+// the remaining connections in their (possibly high) colours: compact() moves them back
+// to the lowest colours available and drops the empty batches.
+// Connect must expose getNode0() and getNode1(), and the nodes getRWConnections().
+template <typename Connect> class ConnectionColouring {
+private:
+	struct Slot {
+		size_t colour;
+		size_t index; // position in its batch
+	};
+	vector<vector<Connect *>> batches;
+	unordered_map<Connect *, Slot> slots;
+	vector<char> used; // scratch: colours taken by the neighbouring connections
+	size_t nbRemovedSinceCompaction = 0;
+
+	// lowest colour not used by the other connections of c's nodes
+	size_t firstFreeColour(Connect *c) {
+		used.assign(batches.size() + 1, false);
+		markUsed(c->getNode0(), c);
+		markUsed(c->getNode1(), c);
+		return find(used.begin(), used.end(), false) - used.begin();
+	}
+
+	void removeFromBatch(typename unordered_map<Connect *, Slot>::iterator it) {
+		auto &batch = batches[it->second.colour];
+		Connect *last = batch.back();
+		batch[it->second.index] = last;
+		slots[last].index = it->second.index;
+		batch.pop_back();
+	}
+
+	template <typename N> void markUsed(N *node, Connect *c) {
+		for (auto &other : node->getRWConnections()) {
+			if (other != c) {
+				auto it = slots.find(other);
+				if (it != slots.end()) used[it->second.colour] = true;
+			}
+		}
+	}
+
+public:
+	const vector<vector<Connect *>> &getBatches() const { return batches; }
+	size_t size() const { return slots.size(); }
+	bool contains(Connect *c) const { return slots.count(c) > 0; }
+	size_t getColour(Connect *c) const { return slots.at(c).colour; }
+
+	// nb of non empty batches
+	size_t getNbColours() const {
+		return count_if(batches.begin(), batches.end(),
+		                [](const vector<Connect *> &b) { return !b.empty(); });
+	}
+
+	size_t getNbRemovedSinceCompaction() const { return nbRemovedSinceCompaction; }
+
+	void clear() {
+		batches.clear();
+		slots.clear();
+		nbRemovedSinceCompaction = 0;
+	}
+
+	void rebuild(const vector<Connect *> &connections) {
+		clear();
+		for (auto &c : connections) add(c);
+	}
+
+	// c must already be registered in its nodes' connection lists
+	void add(Connect *c) {
+		if (contains(c)) return;
+		size_t colour = firstFreeColour(c);
+		if (colour == batches.size()) batches.emplace_back();
+		slots[c] = {colour, batches[colour].size()};
+		batches[colour].push_back(c);
+	}
+
+	void remove(Connect *c) {
+		auto it = slots.find(c);
+		if (it == slots.end()) return;
+		removeFromBatch(it);
+		slots.erase(it);
+		while (!batches.empty() && batches.back().empty()) batches.pop_back();
+		++nbRemovedSinceCompaction;
+	}
+
+	// greedy recolouring, highest colours first, then removal of the empty batches
+	void compact() {
+		for (size_t colour = batches.size(); colour-- > 0;) {
+			for (size_t i = batches[colour].size(); i-- > 0;) {
+				Connect *c = batches[colour][i];
+				size_t lower = firstFreeColour(c);
+				if (lower >= colour) continue;
+				auto it = slots.find(c);
+				removeFromBatch(it);
+				it->second = {lower, batches[lower].size()};
+				batches[lower].push_back(c);
+			}
+		}
+		batches.erase(remove_if(batches.begin(), batches.end(),
+		                        [](const vector<Connect *> &b) { return b.empty(); }),
+		              batches.end());
+		for (size_t colour = 0; colour < batches.size(); ++colour)
+			for (auto &c : batches[colour]) slots[c].colour = colour;
+		nbRemovedSinceCompaction = 0;
+	}
+};
+}
+#endif
@@ -0,0 +1,204 @@
+#ifndef MECACELL_FLATGRID_HPP
+#define MECACELL_FLATGRID_HPP
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include "tools.h"
+#include "gridindex.hpp"
+
+using namespace std;
+namespace MecaCell {
+// Spatial hash with the same semantics as Grid (an object is inserted in every bucket
+// its bounding cube overlaps, with the same quantisation, and queries return
+// duplicates), but stored flat:
+// - buckets are identified by integer coordinates packed in a 64 bits key
+// - an open addressing table (linear probing) maps keys to bucket ids
+// - all the objects live in one contiguous array, bucket b being the range
+//   [offsets[b], offsets[b+1]) (CSR layout)
+// Objects are first staged with insert(), then build() lays them out. clear() keeps
+// every allocation and is O(1) (table slots are invalidated with an epoch counter).
+template <typename O> class FlatGrid {
+private:
+	double cellSize; // actually it's 1/cellSize, just so we can multiply
+
+	// open addressing table
+	vector<uint64_t> slotKeys;
+	vector<uint32_t> slotBuckets;
+	vector<uint32_t> slotEpochs;
+	uint32_t epoch = 1;
+	size_t mask = 0; // capacity - 1
+
+	// buckets
+	vector<uint64_t> bucketKeys;
+	vector<uint32_t> offsets; // CSR offsets, size = nbBuckets + 1 once built
+	vector<O> items;
+
+	// staging
+	vector<pair<uint32_t, O>> staged; // bucket id, object
+
+	static uint64_t hash(uint64_t k) { return GridIndex::mix(k); }
+
+	// buckets overlapped by the bounding cube of the sphere (coord, r), inclusive, computed
+	// exactly as Grid does
+	struct BucketRange {
+		int m[3], M[3];
+	};
+	BucketRange getBucketRange(const Vec &coord, double r) const {
+		const Vec c = coord * cellSize;
+		const double s = r * cellSize;
+		return {{double2int(c.x - s), double2int(c.y - s), double2int(c.z - s)},
+		        {double2int(c.x + s), double2int(c.y + s), double2int(c.z + s)}};
+	}
+
+	void rehash(size_t capacity) {
+		slotKeys.assign(capacity, 0);
+		slotBuckets.assign(capacity, 0);
+		slotEpochs.assign(capacity, 0);
+		epoch = 1;
+		mask = capacity - 1;
+		for (uint32_t b = 0; b < bucketKeys.size(); ++b) {
+			size_t s = hash(bucketKeys[b]) & mask;
+			while (slotEpochs[s] == epoch) s = (s + 1) & mask;
+			slotKeys[s] = bucketKeys[b];
+			slotBuckets[s] = b;
+			slotEpochs[s] = epoch;
+		}
+	}
+
+	// returns the bucket id for key k, creating the bucket if needed
+	uint32_t getOrCreateBucket(uint64_t k) {
+		if ((bucketKeys.size() + 1) * 2 > slotKeys.size())
+			rehash(max<size_t>(64, slotKeys.size() * 2));
+		size_t s = hash(k) & mask;
+		while (slotEpochs[s] == epoch) {
+			if (slotKeys[s] == k) return slotBuckets[s];
+			s = (s + 1) & mask;
+		}
+		uint32_t b = bucketKeys.size();
+		slotKeys[s] = k;
+		slotBuckets[s] = b;
+		slotEpochs[s] = epoch;
+		bucketKeys.push_back(k);
+		return b;
+	}
+
+public:
+	FlatGrid(double cs) : cellSize(1.0 / cs) {}
+
+	double getCellSize() const { return 1.0 / cellSize; }
+	void setCellSize(double cs) {
+		cellSize = 1.0 / cs;
+		clear();
+	}
+	size_t getNbBuckets() const { return bucketKeys.size(); }
+	size_t getNbItems() const { return items.size(); }
+	// average nb of objects per non empty bucket
+	double getOccupancy() const {
+		return bucketKeys.empty() ? 0.0 : static_cast<double>(items.size()) /
+		                                      static_cast<double>(bucketKeys.size());
+	}
+
+	static uint64_t key(int x, int y, int z) { return GridIndex::pack(x, y, z); }
+	// bucket coordinate, rounded to the nearest integer as in Grid
+	int cellCoord(double v) const { return double2int(v * cellSize); }
+
+	// bucket id for key k, or -1
+	int64_t findBucket(uint64_t k) const {
+		if (slotKeys.empty()) return -1;
+		size_t s = hash(k) & mask;
+		while (slotEpochs[s] == epoch) {
+			if (slotKeys[s] == k) return slotBuckets[s];
+			s = (s + 1) & mask;
+		}
+		return -1;
+	}
+
+	// content of bucket b (only valid after build())
+	const O *bucketBegin(size_t b) const { return items.data() + offsets[b]; }
+	const O *bucketEnd(size_t b) const { return items.data() + offsets[b + 1]; }
+
+	void clear() {
+		bucketKeys.clear(); // first: rehash reinserts the current buckets
+		offsets.clear();
+		items.clear();
+		staged.clear();
+		if (++epoch == 0) rehash(slotKeys.size()); // epoch wrapped around
+	}
+
+	void insert(const O &obj) {
+		const BucketRange b = getBucketRange(ptr(obj)->getPosition(), ptr(obj)->getRadius());
+		for (int i = b.m[0]; i <= b.M[0]; ++i)
+			for (int j = b.m[1]; j <= b.M[1]; ++j)
+				for (int k = b.m[2]; k <= b.M[2]; ++k) staged.emplace_back(getOrCreateBucket(key(i, j, k)), obj);
+	}
+
+	// lays the staged objects out in the CSR arrays (counting sort on the bucket id,
+	// stable: objects keep their insertion order inside a bucket)
+	void build() {
+		offsets.assign(bucketKeys.size() + 1, 0);
+		for (const auto &s : staged) ++offsets[s.first + 1];
+		for (size_t b = 1; b < offsets.size(); ++b) offsets[b] += offsets[b - 1];
+		items.resize(staged.size());
+		vector<uint32_t> &cursor = offsets; // reuse: shift back after the scatter
+		for (const auto &s : staged) items[cursor[s.first]++] = s.second;
+		for (size_t b = offsets.size() - 1; b > 0; --b) offsets[b] = offsets[b - 1];
+		offsets[0] = 0;
+		staged.clear();
+	}
+
+	// calls f(begin, end) for the content of every bucket overlapped by the sphere (coord, r)
+	template <typename F> void forEachBucket(const Vec &coord, double r, F f) const {
+		const BucketRange br = getBucketRange(coord, r);
+		for (int i = br.m[0]; i <= br.M[0]; ++i)
+			for (int j = br.m[1]; j <= br.M[1]; ++j)
+				for (int k = br.m[2]; k <= br.M[2]; ++k) {
+					int64_t b = findBucket(key(i, j, k));
+					if (b >= 0) f(bucketBegin(b), bucketEnd(b));
+				}
+	}
+
+	// calls f(o) for every object o in the buckets overlapped by the sphere (coord, r)
+	template <typename F> void forEachNeighbour(const Vec &coord, double r, F f) const {
+		forEachBucket(coord, r, [&](const O *b, const O *e) {
+			for (const O *o = b; o != e; ++o) f(*o);
+		});
+	}
+
+	template <typename F> void forEachNeighbour(const O &obj, F f) const {
+		forEachNeighbour(ptr(obj)->getPosition(), ptr(obj)->getRadius(), f);
+	}
+
+	// pair engine, same as Grid::forEachPairOf
+	template <typename F> size_t forEachPairOf(const O &obj, F f) const {
+		const BucketRange r = getBucketRange(ptr(obj)->getPosition(), ptr(obj)->getRadius());
+		size_t nbVisited = 0;
+		for (int i = r.m[0]; i <= r.M[0]; ++i)
+			for (int j = r.m[1]; j <= r.M[1]; ++j)
+				for (int k = r.m[2]; k <= r.M[2]; ++k) {
+					int64_t b = findBucket(key(i, j, k));
+					if (b < 0) continue;
+					nbVisited += offsets[b + 1] - offsets[b];
+					for (const O *o = bucketBegin(b); o != bucketEnd(b); ++o) {
+						if (!positionOrder(obj, *o)) continue;
+						const BucketRange ro =
+						    getBucketRange(ptr(*o)->getPosition(), ptr(*o)->getRadius());
+						if (i == max(r.m[0], ro.m[0]) && j == max(r.m[1], ro.m[1]) &&
+						    k == max(r.m[2], ro.m[2]))
+							f(obj, *o);
+					}
+				}
+		return nbVisited;
+	}
+
+	vector<O> retrieve(const Vec &coord, double r) const {
+		vector<O> res;
+		forEachBucket(coord, r, [&](const O *b, const O *e) { res.insert(res.end(), b, e); });
+		return res;
+	}
+
+	vector<O> retrieve(const O &obj) const {
+		return retrieve(ptr(obj)->getPosition(), ptr(obj)->getRadius());
+	}
+};
+}
+#endif
@@ -0,0 +1,44 @@
+#ifndef MECACELL_FLATSET_HPP
+#define MECACELL_FLATSET_HPP
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+namespace MecaCell {
+// Set stored as a sorted contiguous vector: O(log k) membership tests, and insertion /
+// removal that only move a few elements for the small k (a cell's neighbours) it is
+// meant for, without the per node allocations of std::set or unordered_set.
+template <typename T> class FlatSet {
+private:
+	vector<T> content;
+
+public:
+	using const_iterator = typename vector<T>::const_iterator;
+	const_iterator begin() const { return content.begin(); }
+	const_iterator end() const { return content.end(); }
+	size_t size() const { return content.size(); }
+	bool empty() const { return content.empty(); }
+	void clear() { content.clear(); }
+	void reserve(size_t n) { content.reserve(n); }
+	const vector<T> &getVector() const { return content; }
+
+	size_t count(const T &e) const { return binary_search(content.begin(), content.end(), e); }
+
+	// returns false if e was already there
+	bool insert(const T &e) {
+		auto it = lower_bound(content.begin(), content.end(), e);
+		if (it != content.end() && *it == e) return false;
+		content.insert(it, e);
+		return true;
+	}
+
+	// returns false if e was not there
+	bool erase(const T &e) {
+		auto it = lower_bound(content.begin(), content.end(), e);
+		if (it == content.end() || *it != e) return false;
+		content.erase(it);
+		return true;
+	}
+};
+}
+#endif
@@ -5,27 +5,85 @@
 #include <set>
 #include <iostream>
 #include <unordered_map>
+#include <algorithm>
 #include "tools.h"
+#include "gridindex.hpp"
 using namespace std;
 
 namespace MecaCell {
 template <typename O> class Grid {
 private:
 	double cellSize; // actually it's 1/cellSize, just so we can multiply
-	unordered_map<Vec, vector<O>> um;
+	unordered_map<GridIndex, vector<O>> um;
+
+	// incremental mode (see update()): bucket range of each object, inclusive
+	struct BucketRange {
+		int m[3], M[3];
+		bool operator==(const BucketRange &r) const {
+			return m[0] == r.m[0] && m[1] == r.m[1] && m[2] == r.m[2] && M[0] == r.M[0] &&
+			       M[1] == r.M[1] && M[2] == r.M[2];
+		}
+	};
+	struct Tracked {
+		BucketRange range;
+		unsigned int stamp;
+	};
+	unordered_map<const void *, Tracked> tracked; // ptr(obj) -> range
+	unsigned int stamp = 0;
+	vector<pair<O, BucketRange>> toRemove, toInsert; // scratch
+	size_t lastNbMoved = 0;
+	bool lastUpdateWasRebuild = false;
+
+	// same buckets as insert(obj)
+	BucketRange getBucketRange(const O &obj) const {
+		Vec center = ptr(obj)->getPosition() * cellSize;
+		double radius = ptr(obj)->getRadius() * cellSize;
+		return {{double2int(center.x - radius), double2int(center.y - radius),
+		         double2int(center.z - radius)},
+		        {double2int(center.x + radius), double2int(center.y + radius),
+		         double2int(center.z + radius)}};
+	}
+
+	template <typename F> static void forEachBucket(const BucketRange &r, F f) {
+		for (int i = r.m[0]; i <= r.M[0]; ++i)
+			for (int j = r.m[1]; j <= r.M[1]; ++j)
+				for (int k = r.m[2]; k <= r.M[2]; ++k) f(GridIndex(i, j, k));
+	}
+
+	void removeFromBuckets(const O &obj, const BucketRange &r) {
+		forEachBucket(r, [&](const GridIndex &v) {
+			auto it = um.find(v);
+			if (it != um.end()) {
+				auto &b = it->second;
+				auto e = find(b.begin(), b.end(), obj);
+				if (e != b.end()) {
+					*e = b.back();
+					b.pop_back();
+				}
+				if (b.empty()) um.erase(it);
+			}
+		});
+	}
 
 public:
 	Grid(double cs) : cellSize(1.0 / cs) {}
 
 	double getCellSize() const { return 1.0 / cellSize; }
-	const unordered_map<Vec, vector<O>> &getContent() const { return um; }
+	// empties the grid
+	void setCellSize(double cs) {
+		cellSize = 1.0 / cs;
+		clear();
+	}
+	const unordered_map<GridIndex, vector<O>> &getContent() const { return um; }
+	// average nb of objects per non empty bucket
+	double getOccupancy() const {
+		size_t n = 0;
+		for (const auto &b : um) n += b.second.size();
+		return um.empty() ? 0.0 : static_cast<double>(n) / static_cast<double>(um.size());
+	}
 
 	void insert(const O &obj) {
-		Vec center = ptr(obj)->getPosition() * cellSize;
-		double radius = ptr(obj)->getRadius() * cellSize;
-		Vec minCorner = center - radius;
-		Vec maxCorner = center + radius;
-		minCorner.iterateTo(maxCorner, [&](Vec v) { um[v].push_back(obj); });
+		forEachBucket(getBucketRange(obj), [&](const GridIndex &v) { um[v].push_back(obj); });
 	}
 
 	void insert(const O &obj, const Vec &p0, const Vec &p1,
@@ -35,8 +93,9 @@ public:
 		Vec trb(max(p0.x, max(p1.x, p2.x)), max(p0.y, max(p1.y, p2.y)),
 		        max(p0.z, max(p1.z, p2.z)));
 		double cs = 1.0 / cellSize;
-		getIndexFromPosition(blf).iterateTo(getIndexFromPosition(trb) + 1, [&](const Vec &v) {
-			Vec center = cs * v;
+		GridIndex m = getIndexFromPosition(blf), M = getIndexFromPosition(trb);
+		forEachBucket({{m.x, m.y, m.z}, {M.x + 1, M.y + 1, M.z + 1}}, [&](const GridIndex &v) {
+			Vec center = cs * v.toVec();
 			std::pair<bool, Vec> projec = projectionIntriangle(p0, p1, p2, center);
 			if ((center - projec.second).sqlength() < 0.8 * cs * cs) {
 				if (projec.first || closestDistToTriangleEdge(p0, p1, p2, center) < 0.87 * cs) {
@@ -46,51 +105,87 @@ public:
 		});
 	}
 
-	Vec getIndexFromPosition(const Vec &v) {
+	GridIndex getIndexFromPosition(const Vec &v) const {
 		Vec res = v * cellSize;
-		return Vec(floor(res.x), floor(res.y), floor(res.z));
+		return GridIndex(floor(res.x), floor(res.y), floor(res.z));
 	}
 
 	set<O> retrieveUnique(const Vec &coord, double r) const {
 		set<O> res;
+		forEachNeighbour(coord, r, [&](const O &o) { res.insert(o); });
+		return res;
+	}
+
+	// same content & order as retrieveUnique, but written into res (cleared first), a flat
+	// buffer that can be reused across queries so that nothing is allocated once it has
+	// grown to the largest query
+	void retrieveUnique(const Vec &coord, double r, vector<O> &res) const {
+		res.clear();
+		forEachNeighbour(coord, r, [&](const O &o) { res.push_back(o); });
+		sort(res.begin(), res.end());
+		res.erase(unique(res.begin(), res.end()), res.end());
+	}
+
+	// calls f(bucket) for every (non empty) bucket overlapped by the sphere (coord, r)
+	template <typename F> void forEachBucket(const Vec &coord, double r, F f) const {
 		Vec center = coord * cellSize;
 		double radius = r * cellSize;
-		Vec minCorner = center - radius;
-		Vec maxCorner = center + radius;
-		// TODO check if faster with a set (uniques...) and by removing  selfcollision
-		minCorner.iterateTo(maxCorner, [&](const Vec &v) {
-			if (um.count(v)) {
-				for (auto &e : um.at(v)) {
-					res.insert(e);
+		const int x0 = double2int(center.x - radius), x1 = double2int(center.x + radius);
+		const int y0 = double2int(center.y - radius), y1 = double2int(center.y + radius);
+		const int z0 = double2int(center.z - radius), z1 = double2int(center.z + radius);
+		for (int i = x0; i <= x1; ++i)
+			for (int j = y0; j <= y1; ++j)
+				for (int k = z0; k <= z1; ++k) {
+					auto it = um.find(GridIndex(i, j, k));
+					if (it != um.end()) f(it->second);
 				}
+	}
+
+	// calls f(o) for every object o in the buckets overlapped by the sphere (coord, r).
+	// An object spanning several buckets is visited several times.
+	template <typename F> void forEachNeighbour(const Vec &coord, double r, F f) const {
+		forEachBucket(coord, r, [&](const vector<O> &bucket) {
+			for (const auto &o : bucket) f(o);
+		});
+	}
+
+	template <typename F> void forEachNeighbour(const O &obj, F f) const {
+		forEachNeighbour(ptr(obj)->getPosition(), ptr(obj)->getRadius(), f);
+	}
+
+	// Pair engine for objects inserted in several buckets: calls f(obj, o) for every object
+	// o sharing a bucket with obj that comes after it in positionOrder, once, from the
+	// first bucket (lowest coordinates) both objects are in. Calling it for
+	// every object reports each candidate pair exactly once, without per object state.
+	// Returns the nb of objects visited
+	template <typename F> size_t forEachPairOf(const O &obj, F f) const {
+		const BucketRange r = getBucketRange(obj);
+		size_t nbVisited = 0;
+		forEachBucket(r, [&](const GridIndex &v) {
+			auto it = um.find(v);
+			if (it == um.end()) return;
+			nbVisited += it->second.size();
+			for (const auto &o : it->second) {
+				if (!positionOrder(obj, o)) continue;
+				const BucketRange ro = getBucketRange(o);
+				if (v.x == max(r.m[0], ro.m[0]) && v.y == max(r.m[1], ro.m[1]) &&
+				    v.z == max(r.m[2], ro.m[2]))
+					f(obj, o);
 			}
 		});
-		return res;
+		return nbVisited;
 	}
 
 	vector<O> retrieve(const Vec &coord, double r) const {
 		vector<O> res;
-		Vec center = coord * cellSize;
-		double radius = r * cellSize;
-		Vec minCorner = center - radius;
-		Vec maxCorner = center + radius;
-		// TODO check if faster with a set (uniques...) and by removing  selfcollision
-		minCorner.iterateTo(maxCorner, [&](const Vec &v) {
-			if (um.count(v)) res.insert(res.end(), um.at(v).begin(), um.at(v).end());
+		forEachBucket(coord, r, [&](const vector<O> &bucket) {
+			res.insert(res.end(), bucket.begin(), bucket.end());
 		});
 		return res;
 	}
 
 	vector<O> retrieve(const O &obj) const {
-		vector<O> res;
-		Vec center = ptr(obj)->getPosition() * cellSize;
-		double radius = ptr(obj)->getRadius() * cellSize;
-		Vec minCorner = center - radius;
-		Vec maxCorner = center + radius;
-		minCorner.iterateTo(maxCorner, [this, &res](const Vec &v) {
-			if (um.count(v)) res.insert(res.end(), um.at(v).begin(), um.at(v).end());
-		});
-		return res;
+		return retrieve(ptr(obj)->getPosition(), ptr(obj)->getRadius());
 	}
 
 	double computeSurface() const {
@@ -116,18 +211,79 @@ public:
 	}
 
 	// nb of occupied neighbour grid cells
-	int getNbNeighbours(const Vec &cell) const {
+	int getNbNeighbours(const GridIndex &cell) const {
 		int res = 0;
-		if (um.count(cell - Vec(0, 0, 1))) ++res;
-		if (um.count(cell - Vec(0, 1, 0))) ++res;
-		if (um.count(cell - Vec(1, 0, 0))) ++res;
-		if (um.count(cell + Vec(0, 0, 1))) ++res;
-		if (um.count(cell + Vec(0, 1, 0))) ++res;
-		if (um.count(cell + Vec(1, 0, 0))) ++res;
+		if (um.count(cell - GridIndex(0, 0, 1))) ++res;
+		if (um.count(cell - GridIndex(0, 1, 0))) ++res;
+		if (um.count(cell - GridIndex(1, 0, 0))) ++res;
+		if (um.count(cell + GridIndex(0, 0, 1))) ++res;
+		if (um.count(cell + GridIndex(0, 1, 0))) ++res;
+		if (um.count(cell + GridIndex(1, 0, 0))) ++res;
 		return res;
 	}
 
-	void clear() { um.clear(); }
+	// Incremental alternative to clear() + insert(all objs): only the objects whose bucket
+	// range changed since the previous call are removed & reinserted, objects that are not
+	// in objs anymore are removed. If more than rebuildRatio * objs.size() objects changed,
+	// the grid is rebuilt from scratch instead. Objects are tracked by ptr(obj), so this is
+	// meant for grids of pointers, and should not be mixed with insert().
+	template <typename Container> void update(const Container &objs, double rebuildRatio = 0.3) {
+		++stamp;
+		toRemove.clear();
+		toInsert.clear();
+		size_t nbSeen = 0; // already tracked objects
+		for (const auto &o : objs) {
+			BucketRange r = getBucketRange(o);
+			auto it = tracked.find(ptr(o));
+			if (it == tracked.end()) {
+				tracked[ptr(o)] = {r, stamp};
+				toInsert.push_back({o, r});
+			} else {
+				++nbSeen;
+				it->second.stamp = stamp;
+				if (!(it->second.range == r)) {
+					toRemove.push_back({o, it->second.range});
+					toInsert.push_back({o, r});
+					it->second.range = r;
+				}
+			}
+		}
+		size_t nbGone = tracked.size() - toInsert.size() + toRemove.size() - nbSeen;
+		lastNbMoved = toInsert.size() + nbGone;
+		lastUpdateWasRebuild = um.empty() || lastNbMoved > rebuildRatio * objs.size();
+		if (lastUpdateWasRebuild) {
+			um.clear();
+			tracked.clear();
+			for (const auto &o : objs) {
+				tracked[ptr(o)] = {getBucketRange(o), stamp};
+				insert(o);
+			}
+			return;
+		}
+		if (nbGone > 0) {
+			for (auto it = tracked.begin(); it != tracked.end();) {
+				if (it->second.stamp != stamp) {
+					// only the pointer value is needed to find the object in its buckets
+					removeFromBuckets(static_cast<O>(const_cast<void *>(it->first)),
+					                  it->second.range);
+					it = tracked.erase(it);
+				} else
+					++it;
+			}
+		}
+		for (const auto &o : toRemove) removeFromBuckets(o.first, o.second);
+		for (const auto &o : toInsert)
+			forEachBucket(o.second, [&](const GridIndex &v) { um[v].push_back(o.first); });
+	}
+
+	// nb of objects inserted, moved or removed by the last update()
+	size_t getLastNbMoved() const { return lastNbMoved; }
+	bool getLastUpdateWasRebuild() const { return lastUpdateWasRebuild; }
+
+	void clear() {
+		um.clear();
+		tracked.clear();
+	}
 };
 }
 #endif
@@ -0,0 +1,51 @@
+#ifndef MECACELL_GRIDINDEX_HPP
+#define MECACELL_GRIDINDEX_HPP
+#include <cstdint>
+#include <functional>
+#include "tools.h"
+
+using namespace std;
+namespace MecaCell {
+// integer coordinates of a grid bucket
+struct GridIndex {
+	static const uint64_t COORD_BITS = 21;
+	static const int64_t COORD_OFFSET = 1 << (COORD_BITS - 1);
+	static const uint64_t COORD_MASK = (uint64_t(1) << COORD_BITS) - 1;
+
+	int x = 0, y = 0, z = 0;
+
+	GridIndex() {}
+	GridIndex(int X, int Y, int Z) : x(X), y(Y), z(Z) {}
+
+	Vec toVec() const { return Vec(x, y, z); }
+	bool operator==(const GridIndex &g) const { return x == g.x && y == g.y && z == g.z; }
+	bool operator!=(const GridIndex &g) const { return !(*this == g); }
+	GridIndex operator+(const GridIndex &g) const { return GridIndex(x + g.x, y + g.y, z + g.z); }
+	GridIndex operator-(const GridIndex &g) const { return GridIndex(x - g.x, y - g.y, z - g.z); }
+
+	// 21 bits per coordinate (±2^20 buckets), unique for coordinates in that range
+	static uint64_t pack(int x, int y, int z) {
+		return ((uint64_t(x + COORD_OFFSET) & COORD_MASK) << (2 * COORD_BITS)) |
+		       ((uint64_t(y + COORD_OFFSET) & COORD_MASK) << COORD_BITS) |
+		       (uint64_t(z + COORD_OFFSET) & COORD_MASK);
+	}
+	uint64_t pack() const { return pack(x, y, z); }
+
+	// splitmix64 finalizer: neighbouring keys end up far apart
+	static uint64_t mix(uint64_t k) {
+		k ^= k >> 30;
+		k *= 0xbf58476d1ce4e5b9ULL;
+		k ^= k >> 27;
+		k *= 0x94d049bb133111ebULL;
+		k ^= k >> 31;
+		return k;
+	}
+	size_t getHash() const { return static_cast<size_t>(mix(pack())); }
+};
+}
+namespace std {
+template <> struct hash<MecaCell::GridIndex> {
+	std::size_t operator()(const MecaCell::GridIndex &g) const { return g.getHash(); }
+};
+}
+#endif
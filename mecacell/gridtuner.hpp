@@ -0,0 +1,122 @@
+#ifndef MECACELL_GRIDTUNER_HPP
+#define MECACELL_GRIDTUNER_HPP
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+using namespace std;
+namespace MecaCell {
+// what a grid looked like during one frame
+struct GridMeasure {
+	double cellSize = 0;
+	size_t nbStored = 0;         // objects inserted in the grid
+	size_t nbQueries = 0;        // queries made during the frame
+	vector<double> storedRadii;  // sample of the inserted objects' radii
+	vector<double> queryRadii;   // sample of the queries' radii
+	double candidatesPerQuery = 0;
+	double occupancy = 0;        // objects per non empty bucket
+};
+
+// Chooses a grid cell size from a cost model of a frame (insertion + queries) in a grid
+// where objects are inserted in every bucket their bounding cube overlaps. For a bucket
+// size s, an object of radius r overlaps (1 + 2r/s)^3 buckets, and a query of radius q
+// gets rho * E[(s + 2q)^3] * E[(s + 2r)^3] / s^3 candidates, rho (the density) being
+// calibrated on the measured nb of candidates per query. When the occupancy was measured,
+// the buckets created are counted too: the measured non empty buckets (insertions /
+// occupancy) cover a volume that buckets of size s cut in (s0 / s)^3 times as many (at
+// most one per insertion), so sparse scenes favour larger buckets. The size only changes
+// when the best estimated cost is below (1 - margin) times the cost of the current size.
+class GridTuner {
+private:
+	size_t period = 50;  // frames between evaluations
+	double margin = 0.2;
+	double bucketCost = 2.0;     // cost of a bucket visit (hash lookup) ...
+	double candidateCost = 1.0;  // ... relative to the cost of a candidate
+	double creationCost = 4.0;   // and of a bucket creation (allocation)
+	// candidate sizes, as multiples of the mean query diameter
+	vector<double> factors = {{1.0, 1.25, 1.5, 2.0, 2.5, 3.0, 4.0, 5.0, 6.0, 8.0}};
+
+	// stats
+	size_t nbEvaluations = 0;
+	size_t nbChanges = 0;
+	double lastDensity = 0;
+	double lastCurrentCost = 0;
+	double lastBestCost = 0;
+	double lastBestSize = 0;
+	GridMeasure lastMeasure;
+
+	static double meanCube(const vector<double> &radii, double s) {
+		double res = 0;
+		for (const auto &r : radii) res += pow(s + 2.0 * r, 3);
+		return radii.empty() ? pow(s, 3) : res / static_cast<double>(radii.size());
+	}
+
+public:
+	size_t getPeriod() const { return period; }
+	void setPeriod(size_t p) { period = p; }
+	double getMargin() const { return margin; }
+	void setMargin(double m) { margin = m; }
+	void setCosts(double bucket, double candidate, double creation = 4.0) {
+		bucketCost = bucket;
+		candidateCost = candidate;
+		creationCost = creation;
+	}
+	bool isDue(int frame) const { return period > 0 && frame % period == 0; }
+
+	size_t getNbEvaluations() const { return nbEvaluations; }
+	size_t getNbChanges() const { return nbChanges; }
+	double getLastDensity() const { return lastDensity; }
+	double getLastCurrentCost() const { return lastCurrentCost; }
+	// best candidate of the last evaluation (only adopted if it beats the margin)
+	double getLastBestCost() const { return lastBestCost; }
+	double getLastBestSize() const { return lastBestSize; }
+	const GridMeasure &getLastMeasure() const { return lastMeasure; }
+
+	// estimated cost of a frame with bucket size s, for a density rho
+	double estimateCost(const GridMeasure &m, double s, double rho) const {
+		double s3 = pow(s, 3);
+		double insertions = m.nbStored * meanCube(m.storedRadii, s) / s3;
+		double visits = m.nbQueries * meanCube(m.queryRadii, s) / s3;
+		double candidates =
+		    m.nbQueries * rho * meanCube(m.queryRadii, s) * meanCube(m.storedRadii, s) / s3;
+		double buckets = 0;
+		if (m.occupancy > 0 && m.cellSize > 0) {
+			const double s0 = m.cellSize;
+			double measured = m.nbStored * meanCube(m.storedRadii, s0) / pow(s0, 3) / m.occupancy;
+			buckets = min(insertions, max(1.0, measured * pow(s0 / s, 3)));
+		}
+		return bucketCost * (insertions + visits) + creationCost * buckets +
+		       candidateCost * candidates;
+	}
+
+	// returns the cell size to use from now on (m.cellSize if it should not change)
+	double evaluate(const GridMeasure &m) {
+		++nbEvaluations;
+		lastMeasure = m;
+		if (m.nbQueries == 0 || m.candidatesPerQuery <= 0 || m.queryRadii.empty())
+			return m.cellSize;
+		const double s0 = m.cellSize;
+		lastDensity = m.candidatesPerQuery * pow(s0, 3) /
+		              (meanCube(m.queryRadii, s0) * meanCube(m.storedRadii, s0));
+		lastCurrentCost = lastBestCost = estimateCost(m, s0, lastDensity);
+		lastBestSize = s0;
+		double meanDiameter = 0;
+		for (const auto &q : m.queryRadii) meanDiameter += 2.0 * q;
+		meanDiameter /= static_cast<double>(m.queryRadii.size());
+		for (const auto &f : factors) {
+			double c = estimateCost(m, f * meanDiameter, lastDensity);
+			if (c < lastBestCost) {
+				lastBestCost = c;
+				lastBestSize = f * meanDiameter;
+			}
+		}
+		if (lastBestCost < (1.0 - margin) * lastCurrentCost) {
+			++nbChanges;
+			return lastBestSize;
+		}
+		return s0;
+	}
+};
+}
+#endif
@@ -0,0 +1,118 @@
+#ifndef MECACELL_KINEMATICSTORE_HPP
+#define MECACELL_KINEMATICSTORE_HPP
+#include <vector>
+#include "tools.h"
+
+// Structure of arrays support (BasicWorld::setStructureOfArrays). When it is compiled out
+// (the default), the Movable & Orientable accessors always use the object's own members:
+// their "bound to a store?" test is a constant and disappears.
+#ifndef MECACELL_STRUCTURE_OF_ARRAYS
+#define MECACELL_STRUCTURE_OF_ARRAYS 0
+#endif
+
+using namespace std;
+namespace MecaCell {
+// Structure of arrays holding the kinematic state of a set of Movable/Orientable nodes.
+// When a node is bound to a store (see Movable::bindKinematics), its getters & setters
+// read and write element kinematicId of these arrays instead of its own members, so that
+// the phases touching every node (integration, force reset) can stream through memory.
+class KinematicStore {
+public:
+	// Movable
+	vector<Vec> position, prevposition, velocity, force;
+	vector<double> totalForce, mass;
+	vector<char> movementEnabled;
+	// Orientable
+	vector<Vec> angularVelocity, torque;
+	vector<Basis<Vec>> orientation;
+	vector<Rotation<Vec>> orientationRotation;
+	vector<double> momentOfInertia; // copied from the nodes, see BasicWorld::updateStats
+
+	size_t size() const { return position.size(); }
+
+	void resize(size_t n) {
+		position.resize(n);
+		prevposition.resize(n);
+		velocity.resize(n);
+		force.resize(n);
+		totalForce.resize(n);
+		mass.resize(n);
+		movementEnabled.resize(n);
+		angularVelocity.resize(n);
+		torque.resize(n);
+		orientation.resize(n);
+		orientationRotation.resize(n);
+		momentOfInertia.resize(n);
+	}
+
+	void clear() { resize(0); }
+
+	void resetForces(size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i) {
+			force[i] = Vec::zero();
+			torque[i] = Vec::zero();
+			totalForce[i] = 0;
+		}
+	}
+
+	// this[i] = other[from[i]]. other must be a different store.
+	void gather(const KinematicStore &other, const vector<size_t> &from) {
+		resize(from.size());
+		for (size_t i = 0; i < from.size(); ++i) {
+			const size_t j = from[i];
+			position[i] = other.position[j];
+			prevposition[i] = other.prevposition[j];
+			velocity[i] = other.velocity[j];
+			force[i] = other.force[j];
+			totalForce[i] = other.totalForce[j];
+			mass[i] = other.mass[j];
+			movementEnabled[i] = other.movementEnabled[j];
+			angularVelocity[i] = other.angularVelocity[j];
+			torque[i] = other.torque[j];
+			orientation[i] = other.orientation[j];
+			orientationRotation[i] = other.orientationRotation[j];
+			momentOfInertia[i] = other.momentOfInertia[j];
+		}
+	}
+
+	void swap(KinematicStore &other) {
+		position.swap(other.position);
+		prevposition.swap(other.prevposition);
+		velocity.swap(other.velocity);
+		force.swap(other.force);
+		totalForce.swap(other.totalForce);
+		mass.swap(other.mass);
+		movementEnabled.swap(other.movementEnabled);
+		angularVelocity.swap(other.angularVelocity);
+		torque.swap(other.torque);
+		orientation.swap(other.orientation);
+		orientationRotation.swap(other.orientationRotation);
+		momentOfInertia.swap(other.momentOfInertia);
+	}
+
+	// view on one element, exposing what the integrators need
+	struct Slot {
+		KinematicStore &s;
+		const size_t i;
+		Slot(KinematicStore &store, size_t id) : s(store), i(id) {}
+		bool isMovementEnabled() const { return s.movementEnabled[i]; }
+		Vec getPosition() const { return s.position[i]; }
+		Vec getVelocity() const { return s.velocity[i]; }
+		Vec getForce() const { return s.force[i]; }
+		double getMass() const { return s.mass[i]; }
+		Vec getAngularVelocity() const { return s.angularVelocity[i]; }
+		Vec getTorque() const { return s.torque[i]; }
+		double getMomentOfInertia() const { return s.momentOfInertia[i]; }
+		Rotation<Vec> getOrientationRotation() const { return s.orientationRotation[i]; }
+		void setPosition(const Vec &p) { s.position[i] = p; }
+		void setPrevposition(const Vec &p) { s.prevposition[i] = p; }
+		void setVelocity(const Vec &v) { s.velocity[i] = v; }
+		void setAngularVelocity(const Vec &v) { s.angularVelocity[i] = v; }
+		void setOrientationRotation(const Rotation<Vec> &r) { s.orientationRotation[i] = r; }
+		void updateCurrentOrientation() {
+			s.orientation[i].updateWithRotation(s.orientationRotation[i]);
+		}
+	};
+};
+}
+#endif
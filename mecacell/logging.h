@@ -0,0 +1,128 @@
+#ifndef MECACELL_LOGGING_H
+#define MECACELL_LOGGING_H
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+// Logging levels. Messages above MECACELL_LOG_LEVEL are removed by the preprocessor (their
+// arguments are not even evaluated), so a build with the default level pays nothing for
+// the traces of the hot paths. Set it on the command line, for example
+// -DMECACELL_LOG_LEVEL=MECACELL_LOG_TRACE to trace the cell-model collisions.
+#define MECACELL_LOG_NONE 0
+#define MECACELL_LOG_ERROR 1
+#define MECACELL_LOG_WARNING 2
+#define MECACELL_LOG_INFO 3
+#define MECACELL_LOG_DEBUG 4
+#define MECACELL_LOG_TRACE 5
+
+#ifndef MECACELL_LOG_LEVEL
+#ifdef NDEBUG
+#define MECACELL_LOG_LEVEL MECACELL_LOG_NONE
+#else
+#define MECACELL_LOG_LEVEL MECACELL_LOG_WARNING
+#endif
+#endif
+
+namespace MecaCell {
+// Runtime side of the logging: where the compiled-in messages go (std::cerr by default, or
+// a buffered file) and a runtime threshold that can only lower the compile-time level.
+class Log {
+private:
+	struct State {
+		std::ostream *sink = &std::cerr;
+		std::unique_ptr<char[]> fileBuffer; // must outlive file
+		std::unique_ptr<std::ofstream> file;
+		std::atomic<int> level{MECACELL_LOG_LEVEL};
+		std::mutex mutex;
+	};
+	static State &state() {
+		static State s;
+		return s;
+	}
+
+public:
+	static const char *levelName(int level) {
+		static const char *names[] = {"", "error", "warning", "info", "debug", "trace"};
+		return level >= MECACELL_LOG_NONE && level <= MECACELL_LOG_TRACE ? names[level] : "";
+	}
+	static int getLevel() { return state().level; }
+	static void setLevel(int level) { state().level = level; }
+	static bool enabled(int level) { return level <= state().level; }
+
+	// messages go to s (which must outlive its use), nullptr = nowhere
+	static void setSink(std::ostream *s) {
+		State &st = state();
+		std::lock_guard<std::mutex> lock(st.mutex);
+		st.sink = s;
+		st.file.reset();
+	}
+	// messages go to a file, through a buffer of bufferSize bytes (only flushed when full,
+	// on flush() and when the program exits)
+	static bool setFile(const std::string &path, size_t bufferSize = 1 << 16) {
+		State &st = state();
+		std::lock_guard<std::mutex> lock(st.mutex);
+		st.file.reset(new std::ofstream());
+		st.fileBuffer.reset(new char[bufferSize]);
+		st.file->rdbuf()->pubsetbuf(st.fileBuffer.get(), bufferSize);
+		st.file->open(path);
+		st.sink = st.file->is_open() ? st.file.get() : &std::cerr;
+		return st.file->is_open();
+	}
+	static void flush() {
+		State &st = state();
+		std::lock_guard<std::mutex> lock(st.mutex);
+		if (st.sink) st.sink->flush();
+	}
+	// writes one message (no flush)
+	static void write(int level, const std::string &msg) {
+		State &st = state();
+		std::lock_guard<std::mutex> lock(st.mutex);
+		if (st.sink) *st.sink << "[" << levelName(level) << "] " << msg << '\n';
+	}
+};
+}
+
+// MECACELL_LOG(level, a << b << ...) formats and writes its stream expression if level
+// is enabled at compile time and at runtime
+#define MECACELL_LOG(level, expr)                                           \
+	do {                                                                      \
+		if ((level) <= MECACELL_LOG_LEVEL && MecaCell::Log::enabled(level)) {   \
+			std::ostringstream mecacell_log_stream;                               \
+			mecacell_log_stream << expr;                                          \
+			MecaCell::Log::write(level, mecacell_log_stream.str());               \
+		}                                                                       \
+	} while (false)
+#define MECACELL_LOG_DISABLED(expr) \
+	do {                              \
+	} while (false)
+
+#if MECACELL_LOG_LEVEL >= MECACELL_LOG_ERROR
+#define MECACELL_ERROR(expr) MECACELL_LOG(MECACELL_LOG_ERROR, expr)
+#else
+#define MECACELL_ERROR(expr) MECACELL_LOG_DISABLED(expr)
+#endif
+#if MECACELL_LOG_LEVEL >= MECACELL_LOG_WARNING
+#define MECACELL_WARNING(expr) MECACELL_LOG(MECACELL_LOG_WARNING, expr)
+#else
+#define MECACELL_WARNING(expr) MECACELL_LOG_DISABLED(expr)
+#endif
+#if MECACELL_LOG_LEVEL >= MECACELL_LOG_INFO
+#define MECACELL_INFO(expr) MECACELL_LOG(MECACELL_LOG_INFO, expr)
+#else
+#define MECACELL_INFO(expr) MECACELL_LOG_DISABLED(expr)
+#endif
+#if MECACELL_LOG_LEVEL >= MECACELL_LOG_DEBUG
+#define MECACELL_DEBUG(expr) MECACELL_LOG(MECACELL_LOG_DEBUG, expr)
+#else
+#define MECACELL_DEBUG(expr) MECACELL_LOG_DISABLED(expr)
+#endif
+#if MECACELL_LOG_LEVEL >= MECACELL_LOG_TRACE
+#define MECACELL_TRACE(expr) MECACELL_LOG(MECACELL_LOG_TRACE, expr)
+#else
+#define MECACELL_TRACE(expr) MECACELL_LOG_DISABLED(expr)
+#endif
+#endif
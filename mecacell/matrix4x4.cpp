@@ -31,7 +31,7 @@ void Matrix4x4::rotate(const Rotation<Vec> &r) {
 	*this = rm * (*this);
 }
 
-Matrix4x4 Matrix4x4::operator*(const Matrix4x4 &N) {
+Matrix4x4 Matrix4x4::operator*(const Matrix4x4 &N) const {
 	return Matrix4x4(
 	    {{{{m[0][0] * N.m[0][0] + m[0][1] * N.m[1][0] + m[0][2] * N.m[2][0] + m[0][3] * N.m[3][0],
 	        m[0][0] * N.m[0][1] + m[0][1] * N.m[1][1] + m[0][2] * N.m[2][1] + m[0][3] * N.m[3][1],
@@ -50,11 +50,32 @@ Matrix4x4 Matrix4x4::operator*(const Matrix4x4 &N) {
 	        m[3][0] * N.m[0][2] + m[3][1] * N.m[1][2] + m[3][2] * N.m[2][2] + m[3][3] * N.m[3][2],
 	        m[3][0] * N.m[0][3] + m[3][1] * N.m[1][3] + m[3][2] * N.m[2][3] + m[3][3] * N.m[3][3]}}}});
 }
-Vec Matrix4x4::operator*(const Vec &v) {
+Vec Matrix4x4::operator*(const Vec &v) const {
 	return Vec(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z + m[0][3],
 	           m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z + m[1][3],
 	           m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z + m[2][3]);
 }
+Matrix4x4 Matrix4x4::affineInverse() const {
+	// inverse of the 3x3 linear part (cofactors / determinant), then of the translation
+	double c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	double c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	double c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	double det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+	double id = 1.0 / det;
+	Matrix4x4 r;
+	r.m[0][0] = c00 * id;
+	r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * id;
+	r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * id;
+	r.m[1][0] = c01 * id;
+	r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * id;
+	r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * id;
+	r.m[2][0] = c02 * id;
+	r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * id;
+	r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * id;
+	for (int i = 0; i < 3; ++i)
+		r.m[i][3] = -(r.m[i][0] * m[0][3] + r.m[i][1] * m[1][3] + r.m[i][2] * m[2][3]);
+	return r;
+}
 ostream &operator<<(ostream &out, const Matrix4x4 &M) {
 	out << endl;
 	for (auto &i : M.m) {
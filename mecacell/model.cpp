@@ -31,21 +31,66 @@ bool Model::changedSinceLastCheck() {
 	return c;
 }
 
+void Model::verticesModified() {
+	verticesUpToDate = false;
+	changed = true;
+	deformed = true;
+}
+bool Model::deformedSinceLastCheck() {
+	bool d = deformed;
+	deformed = false;
+	return d;
+}
+
 void Model::updateFromTransformation() {
-	vertices.clear();
-	normals.clear();
-	for (auto &v : obj.vertices) {
-		vertices.push_back(transformation * v);
-	}
-	for (auto &n : obj.normals) {
-		normals.push_back((transformation * n).normalized());
-	}
+	inverse = transformation.affineInverse();
+	// spectral norm of the inverse's linear part A, bounded by the largest absolute row sum
+	// of A^T A (exact for rotations and uniform scales)
+	double ata[3][3];
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 3; ++j)
+			ata[i][j] = inverse.m[0][i] * inverse.m[0][j] + inverse.m[1][i] * inverse.m[1][j] +
+			            inverse.m[2][i] * inverse.m[2][j];
+	double maxRow = 0;
+	for (int i = 0; i < 3; ++i)
+		maxRow = std::max(maxRow, std::abs(ata[i][0]) + std::abs(ata[i][1]) + std::abs(ata[i][2]));
+	inverseStretch = sqrt(maxRow);
+	verticesUpToDate = false;
 	changed = true;
 }
-void Model::updateFacesFromObj() {
-	for (auto &f : obj.faces) {
-		faces.push_back(f.at("v"));
+
+void Model::updateVertices() const {
+	if (verticesUpToDate) return;
+	vertices.resize(obj.vertices.size());
+	for (size_t i = 0; i < obj.vertices.size(); ++i) vertices[i] = transformation * obj.vertices[i];
+	// normals follow the inverse transpose
+	normals.resize(obj.normals.size());
+	for (size_t i = 0; i < obj.normals.size(); ++i) {
+		const Vec &n = obj.normals[i];
+		normals[i] = Vec(inverse.m[0][0] * n.x + inverse.m[1][0] * n.y + inverse.m[2][0] * n.z,
+		                 inverse.m[0][1] * n.x + inverse.m[1][1] * n.y + inverse.m[2][1] * n.z,
+		                 inverse.m[0][2] * n.x + inverse.m[1][2] * n.y + inverse.m[2][2] * n.z)
+		                 .normalized();
 	}
+	verticesUpToDate = true;
+}
+
+const vector<Vec> &Model::getVertices() const {
+	updateVertices();
+	return vertices;
+}
+const vector<Vec> &Model::getNormals() const {
+	updateVertices();
+	return normals;
+}
+array<Vec, 3> Model::getFaceVertices(size_t f) const {
+	const auto &i = faces[f].indices;
+	if (verticesUpToDate) return {{vertices[i[0]], vertices[i[1]], vertices[i[2]]}};
+	return {{transformation * obj.vertices[i[0]], transformation * obj.vertices[i[1]],
+	         transformation * obj.vertices[i[2]]}};
+}
+void Model::updateFacesFromObj() {
+	faces = obj.faces;
 	changed = true;
 }
 void Model::computeAdjacency() {
@@ -29,15 +29,37 @@ struct Model {
 	void computeAdjacency();
 	void updateFacesFromObj();
 	bool changedSinceLastCheck();
+	// to be called after moving obj.vertices (deformation, the faces stay the same)
+	void verticesModified();
+	bool deformedSinceLastCheck();
+
+	// world space vertices and normals. They are only recomputed when accessed after a
+	// transformation, so moving a model costs O(1) (not thread safe)
+	const vector<Vec> &getVertices() const;
+	const vector<Vec> &getNormals() const;
+	// world space vertices of face f, without updating the whole mesh
+	array<Vec, 3> getFaceVertices(size_t f) const;
+	// from world space to model space (the obj's coordinates) and back
+	Vec toModelSpace(const Vec &p) const { return inverse * p; }
+	Vec toWorldSpace(const Vec &p) const { return transformation * p; }
+	// upper bound of the factor by which toModelSpace stretches lengths (1 for rigid moves)
+	double getInverseStretch() const { return inverseStretch; }
 
 	string name;
 	ObjModel obj;
 	Matrix4x4 transformation;
-	vector<Vec> vertices;
-	vector<Vec> normals;
+	Matrix4x4 inverse; // of transformation
 	vector<Triangle> faces;
 	unordered_map<size_t, unordered_set<size_t>> adjacency; // adjacent faces share at least one vertex
 	bool changed = true;
+	bool deformed = false;
+
+private:
+	double inverseStretch = 1.0;
+	mutable vector<Vec> vertices;
+	mutable vector<Vec> normals;
+	mutable bool verticesUpToDate = false;
+	void updateVertices() const;
 };
 }
 #endif
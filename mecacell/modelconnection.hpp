@@ -58,7 +58,7 @@ struct ModelConnectionPoint {
 template <typename Cell> struct CellModelConnection {
 	using CMConnection = Connection<ModelConnectionPoint, Cell *>;
 	using CSConnection = Connection<SpaceConnectionPoint, Cell *>;
-	Model *model;
+	Model *model = nullptr;
 	CSConnection anchor;  // slide and anchor, only angular
 	CMConnection bounce;  // always perpendicular, only classic spring
 	double maxTeta = 0.1; // this is for the anchor, and should always be smaller than the
@@ -70,7 +70,8 @@ template <typename Cell> struct CellModelConnection {
 	}
 
 	CellModelConnection() {}
-	CellModelConnection(CSConnection a, CMConnection b) : anchor(a), bounce(b) {}
+	CellModelConnection(CSConnection a, CMConnection b)
+	    : model(b.getNode0().model), anchor(a), bounce(b) {}
 	bool dirty = false; // does this connection need to be deleted?
 };
 }
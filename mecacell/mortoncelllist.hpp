@@ -0,0 +1,290 @@
+#ifndef MECACELL_MORTONCELLLIST_HPP
+#define MECACELL_MORTONCELLLIST_HPP
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include "tools.h"
+#include "threadpool.hpp"
+
+using namespace std;
+namespace MecaCell {
+// Cell list rebuilt from scratch by sorting: each object is binned once, by its center,
+// into a bucket whose Morton (Z-order) key is computed relative to the bounding box of
+// the occupied buckets. Objects are then sorted by key with an LSD radix sort (each pass
+// is a two-pass counting sort) into one array, so a bucket is a contiguous range and
+// neighbouring buckets are mostly close in memory. The sorted array is a spatially
+// coherent ordering of the objects (getSortedOrder()).
+// Queries are widened by the largest radius seen during build, since objects are not
+// inserted in every bucket they overlap. Each object is returned at most once.
+template <typename O> class MortonCellList {
+private:
+	static const unsigned int RADIX_BITS = 11;
+	static const unsigned int MAX_COORD_BITS = 21;
+
+	double cellSize; // actually it's 1/cellSize, just so we can multiply
+	double maxRadius = 0;
+	int minCoord[3] = {0, 0, 0};
+	int maxCoord[3] = {-1, -1, -1};
+
+	vector<O> items;            // sorted by key
+	vector<uint64_t> itemKeys;  // key of each item
+	vector<uint64_t> bucketKeys;    // sorted, unique
+	vector<uint32_t> bucketStarts;  // bucket b = [bucketStarts[b], bucketStarts[b+1])
+	vector<int> bucketCoords;       // 3 per bucket
+
+	// scratch
+	vector<int> coords;
+	vector<O> tmpItems;
+	vector<uint64_t> tmpKeys;
+	vector<uint32_t> histograms; // one per chunk
+	vector<int> chunkBounds;
+	vector<double> chunkMaxRadius;
+
+	// spreads the 21 lowest bits of x so that there are 2 zeros between each of them
+	static uint64_t spreadBits(uint64_t x) {
+		x &= 0x1fffff;
+		x = (x | x << 32) & 0x1f00000000ffffULL;
+		x = (x | x << 16) & 0x1f0000ff0000ffULL;
+		x = (x | x << 8) & 0x100f00f00f00f00fULL;
+		x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+		x = (x | x << 2) & 0x1249249249249249ULL;
+		return x;
+	}
+
+	uint64_t keyFromCoords(int x, int y, int z) const {
+		return spreadBits(x - minCoord[0]) | (spreadBits(y - minCoord[1]) << 1) |
+		       (spreadBits(z - minCoord[2]) << 2);
+	}
+
+	// f(begin, end, chunk) on pool, or serially on one chunk if pool is null
+	template <typename F> static void forRanges(ThreadPool *pool, size_t n, const F &f) {
+		if (pool)
+			pool->parallelForRanges(n, f);
+		else
+			f(0, n, 0);
+	}
+
+	// two-pass counting sort of (items, itemKeys) on the digit starting at shift. Each
+	// chunk counts its own digits, then chunk t's items with digit d are placed after
+	// those of the chunks before it, so the result is stable whatever the nb of chunks
+	void countingSortPass(unsigned int shift, ThreadPool *pool) {
+		const uint64_t digitMask = (1 << RADIX_BITS) - 1;
+		const size_t nbDigits = 1 << RADIX_BITS;
+		const size_t n = items.size();
+		const size_t nbChunks = pool ? pool->getNbChunks(n) : 1;
+		histograms.assign(nbChunks * nbDigits, 0);
+		forRanges(pool, n, [&](size_t b, size_t e, size_t t) {
+			uint32_t *h = &histograms[t * nbDigits];
+			for (size_t i = b; i < e; ++i) ++h[(itemKeys[i] >> shift) & digitMask];
+		});
+		uint32_t sum = 0;
+		for (size_t d = 0; d < nbDigits; ++d)
+			for (size_t t = 0; t < nbChunks; ++t) {
+				uint32_t c = histograms[t * nbDigits + d];
+				histograms[t * nbDigits + d] = sum;
+				sum += c;
+			}
+		tmpItems.resize(n);
+		tmpKeys.resize(n);
+		forRanges(pool, n, [&](size_t b, size_t e, size_t t) {
+			uint32_t *h = &histograms[t * nbDigits];
+			for (size_t i = b; i < e; ++i) {
+				uint32_t dest = h[(itemKeys[i] >> shift) & digitMask]++;
+				tmpItems[dest] = items[i];
+				tmpKeys[dest] = itemKeys[i];
+			}
+		});
+		items.swap(tmpItems);
+		itemKeys.swap(tmpKeys);
+	}
+
+	template <typename Container> void buildWith(const Container &objs, ThreadPool *pool) {
+		clear();
+		if (objs.empty()) return;
+		const size_t n = objs.size();
+		const size_t nbChunks = pool ? pool->getNbChunks(n) : 1;
+		coords.resize(3 * n);
+		items.assign(objs.begin(), objs.end());
+		// per chunk bounds (min x, y, z, max x, y, z) and max radius
+		chunkBounds.assign(6 * nbChunks, 0);
+		chunkMaxRadius.assign(nbChunks, 0.0);
+		forRanges(pool, n, [&](size_t b, size_t e, size_t t) {
+			int *bounds = &chunkBounds[6 * t];
+			for (int d = 0; d < 3; ++d) {
+				bounds[d] = numeric_limits<int>::max();
+				bounds[3 + d] = numeric_limits<int>::min();
+			}
+			for (size_t i = b; i < e; ++i) {
+				const Vec p = ptr(items[i])->getPosition();
+				chunkMaxRadius[t] = max(chunkMaxRadius[t], ptr(items[i])->getRadius());
+				coords[3 * i] = cellCoord(p.x);
+				coords[3 * i + 1] = cellCoord(p.y);
+				coords[3 * i + 2] = cellCoord(p.z);
+				for (int d = 0; d < 3; ++d) {
+					bounds[d] = min(bounds[d], coords[3 * i + d]);
+					bounds[3 + d] = max(bounds[3 + d], coords[3 * i + d]);
+				}
+			}
+		});
+		for (int d = 0; d < 3; ++d) {
+			minCoord[d] = numeric_limits<int>::max();
+			maxCoord[d] = numeric_limits<int>::min();
+		}
+		for (size_t t = 0; t < nbChunks; ++t) {
+			maxRadius = max(maxRadius, chunkMaxRadius[t]);
+			for (int d = 0; d < 3; ++d) {
+				minCoord[d] = min(minCoord[d], chunkBounds[6 * t + d]);
+				maxCoord[d] = max(maxCoord[d], chunkBounds[6 * t + 3 + d]);
+			}
+		}
+		// only sort on the bits that are actually used
+		unsigned int coordBits = 1;
+		for (int d = 0; d < 3; ++d)
+			while (coordBits < MAX_COORD_BITS &&
+			       (int64_t(maxCoord[d]) - minCoord[d]) >= (int64_t(1) << coordBits))
+				++coordBits;
+		itemKeys.resize(n);
+		forRanges(pool, n, [&](size_t b, size_t e, size_t) {
+			for (size_t i = b; i < e; ++i)
+				itemKeys[i] = keyFromCoords(coords[3 * i], coords[3 * i + 1], coords[3 * i + 2]);
+		});
+		for (unsigned int shift = 0; shift < 3 * coordBits; shift += RADIX_BITS)
+			countingSortPass(shift, pool);
+		for (size_t i = 0; i < n; ++i) {
+			if (i == 0 || itemKeys[i] != itemKeys[i - 1]) {
+				bucketKeys.push_back(itemKeys[i]);
+				bucketStarts.push_back(i);
+				const Vec p = ptr(items[i])->getPosition();
+				bucketCoords.push_back(cellCoord(p.x));
+				bucketCoords.push_back(cellCoord(p.y));
+				bucketCoords.push_back(cellCoord(p.z));
+			}
+		}
+		bucketStarts.push_back(n);
+	}
+
+public:
+	MortonCellList(double cs) : cellSize(1.0 / cs) {}
+
+	double getCellSize() const { return 1.0 / cellSize; }
+	void setCellSize(double cs) {
+		cellSize = 1.0 / cs;
+		clear();
+	}
+	size_t getNbBuckets() const { return bucketKeys.size(); }
+	size_t getNbItems() const { return items.size(); }
+	double getMaxRadius() const { return maxRadius; }
+	// objects sorted along the Z-order curve (valid until the next build)
+	const vector<O> &getSortedOrder() const { return items; }
+
+	int cellCoord(double v) const { return static_cast<int>(floor(v * cellSize)); }
+
+	void clear() {
+		items.clear();
+		itemKeys.clear();
+		bucketKeys.clear();
+		bucketStarts.clear();
+		bucketCoords.clear();
+		maxRadius = 0;
+		for (int d = 0; d < 3; ++d) {
+			minCoord[d] = 0;
+			maxCoord[d] = -1;
+		}
+	}
+
+	template <typename Container> void build(const Container &objs) {
+		buildWith(objs, nullptr);
+	}
+	// same result as build(objs), the binning and the sort passes being split on pool
+	template <typename Container> void build(const Container &objs, ThreadPool &pool) {
+		buildWith(objs, &pool);
+	}
+
+	// bucket id of bucket (x, y, z), or -1 if it is empty
+	int64_t findBucket(int x, int y, int z) const {
+		if (x < minCoord[0] || x > maxCoord[0] || y < minCoord[1] || y > maxCoord[1] ||
+		    z < minCoord[2] || z > maxCoord[2])
+			return -1;
+		const uint64_t key = keyFromCoords(x, y, z);
+		auto it = lower_bound(bucketKeys.begin(), bucketKeys.end(), key);
+		if (it != bucketKeys.end() && *it == key) return it - bucketKeys.begin();
+		return -1;
+	}
+
+	// Calls f(a, b) exactly once for every unordered pair of objects that can overlap
+	// (or be less than margin apart). Each bucket is paired with itself and with the half
+	// of its neighbours that are after it in lexicographic order (a half shell), which
+	// needs no per-object state.
+	template <typename F> void forEachPair(F f, double margin = 0.0) const {
+		// nb of buckets two overlapping objects can be apart
+		const int reach =
+		    max(1, static_cast<int>(ceil((2.0 * maxRadius + margin) * cellSize)));
+		for (size_t b = 0; b < bucketKeys.size(); ++b) {
+			const O *begin = items.data() + bucketStarts[b];
+			const O *end = items.data() + bucketStarts[b + 1];
+			for (const O *o0 = begin; o0 != end; ++o0)
+				for (const O *o1 = o0 + 1; o1 != end; ++o1) f(*o0, *o1);
+			const int *c = &bucketCoords[3 * b];
+			for (int dx = 0; dx <= reach; ++dx)
+				for (int dy = (dx == 0 ? 0 : -reach); dy <= reach; ++dy)
+					for (int dz = (dx == 0 && dy == 0 ? 1 : -reach); dz <= reach; ++dz) {
+						int64_t n = findBucket(c[0] + dx, c[1] + dy, c[2] + dz);
+						if (n < 0) continue;
+						const O *nBegin = items.data() + bucketStarts[n];
+						const O *nEnd = items.data() + bucketStarts[n + 1];
+						for (const O *o0 = begin; o0 != end; ++o0)
+							for (const O *o1 = nBegin; o1 != nEnd; ++o1) f(*o0, *o1);
+					}
+		}
+	}
+
+	// calls f(begin, end) on every (non empty) bucket, in Z-order
+	template <typename F> void forEachBucket(F f) const {
+		for (size_t b = 0; b < bucketKeys.size(); ++b)
+			f(items.data() + bucketStarts[b], items.data() + bucketStarts[b + 1]);
+	}
+
+	// calls f(begin, end) on the (non empty) buckets that can contain objects overlapping
+	// the sphere (coord, r)
+	template <typename F> void forEachBucket(const Vec &coord, double r, F f) const {
+		if (items.empty()) return;
+		const double R = r + maxRadius;
+		const int x0 = max(cellCoord(coord.x - R), minCoord[0]),
+		          x1 = min(cellCoord(coord.x + R), maxCoord[0]);
+		const int y0 = max(cellCoord(coord.y - R), minCoord[1]),
+		          y1 = min(cellCoord(coord.y + R), maxCoord[1]);
+		const int z0 = max(cellCoord(coord.z - R), minCoord[2]),
+		          z1 = min(cellCoord(coord.z + R), maxCoord[2]);
+		for (int i = x0; i <= x1; ++i)
+			for (int j = y0; j <= y1; ++j)
+				for (int k = z0; k <= z1; ++k) {
+					int64_t b = findBucket(i, j, k);
+					if (b >= 0) f(items.data() + bucketStarts[b], items.data() + bucketStarts[b + 1]);
+				}
+	}
+
+	// calls f(o) for every object o that can overlap the sphere (coord, r)
+	template <typename F> void forEachNeighbour(const Vec &coord, double r, F f) const {
+		forEachBucket(coord, r, [&](const O *b, const O *e) {
+			for (; b != e; ++b) f(*b);
+		});
+	}
+
+	template <typename F> void forEachNeighbour(const O &obj, F f) const {
+		forEachNeighbour(ptr(obj)->getPosition(), ptr(obj)->getRadius(), f);
+	}
+
+	vector<O> retrieve(const Vec &coord, double r) const {
+		vector<O> res;
+		forEachBucket(coord, r, [&](const O *b, const O *e) { res.insert(res.end(), b, e); });
+		return res;
+	}
+
+	vector<O> retrieve(const O &obj) const {
+		return retrieve(ptr(obj)->getPosition(), ptr(obj)->getRadius());
+	}
+};
+}
+#endif
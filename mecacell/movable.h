@@ -1,6 +1,7 @@
 #ifndef MOVABLE_H
 #define MOVABLE_H
 #include "tools.h"
+#include "kinematicstore.hpp"
 
 namespace MecaCell {
 class Movable {
@@ -14,6 +15,20 @@ protected:
 	double baseMass = 1.0;
 	double totalForce = 0;
 
+	// when bound, the state above lives in kinematics at index kinematicId
+	KinematicStore *kinematics = nullptr;
+	size_t kinematicId = 0;
+
+	bool bound() const { return MECACELL_STRUCTURE_OF_ARRAYS && kinematics; }
+	// own member, or its counterpart in the store when bound
+	template <typename T> T &state(T &member, vector<T> KinematicStore::*array) {
+		return bound() ? (kinematics->*array)[kinematicId] : member;
+	}
+	template <typename T>
+	const T &state(const T &member, vector<T> KinematicStore::*array) const {
+		return bound() ? (kinematics->*array)[kinematicId] : member;
+	}
+
 public:
 	/**********************************************
 	 *               CONSTRUCTOR
@@ -21,36 +36,110 @@ public:
 	Movable() {}
 	Movable(Vec pos) : position(pos) {}
 	Movable(Vec pos, double m) : position(pos), mass(m) {}
+	// a copy is never bound to the original's store
+	Movable(const Movable &m)
+	    : position(m.getPosition()),
+	      prevposition(m.getPrevposition()),
+	      velocity(m.getVelocity()),
+	      force(m.getForce()),
+	      movementEnabled(m.isMovementEnabled()),
+	      mass(m.getMass()),
+	      baseMass(m.baseMass),
+	      totalForce(m.getTotalForce()) {}
+	// copies the values, not the binding: they go wherever this object's state lives
+	Movable &operator=(const Movable &m) {
+		if (this != &m) {
+			setPosition(m.getPosition());
+			setPrevposition(m.getPrevposition());
+			setVelocity(m.getVelocity());
+			setForce(m.getForce());
+			setMovementEnabled(m.isMovementEnabled());
+			setMass(m.getMass());
+			baseMass = m.baseMass;
+			state(totalForce, &KinematicStore::totalForce) = m.getTotalForce();
+		}
+		return *this;
+	}
 	/**********************************************
 	 *                GET & SET
 	 **********************************************/
-	bool isMovementEnabled() { return movementEnabled; }
-	void disableMovement() { movementEnabled = false; }
-	void enableMovement() { movementEnabled = true; }
-	Vec getPosition() const { return position; }
-	Vec getPrevposition() const { return prevposition; }
-	Vec getVelocity() const { return velocity; }
-	Vec getForce() const { return force; }
-	double getMass() const { return mass; }
+	bool isMovementEnabled() const {
+		return bound() ? kinematics->movementEnabled[kinematicId] : movementEnabled;
+	}
+	void disableMovement() { setMovementEnabled(false); }
+	void enableMovement() { setMovementEnabled(true); }
+	void setMovementEnabled(bool e) {
+		if (bound())
+			kinematics->movementEnabled[kinematicId] = e;
+		else
+			movementEnabled = e;
+	}
+	Vec getPosition() const { return state(position, &KinematicStore::position); }
+	Vec getPrevposition() const {
+		return state(prevposition, &KinematicStore::prevposition);
+	}
+	Vec getVelocity() const { return state(velocity, &KinematicStore::velocity); }
+	Vec getForce() const { return state(force, &KinematicStore::force); }
+	double getMass() const { return state(mass, &KinematicStore::mass); }
 	double getBaseMass() const { return baseMass; }
-	void setPosition(const Vec &p) { position = p; }
-	void setPrevposition(const Vec &p) { prevposition = p; }
-	void setVelocity(const Vec &v) { velocity = v; }
-	void setForce(const Vec &f) { force = f; }
-	void setMass(const double m) { mass = m; }
+	double getTotalForce() const { return state(totalForce, &KinematicStore::totalForce); }
+	void setPosition(const Vec &p) { state(position, &KinematicStore::position) = p; }
+	void setPrevposition(const Vec &p) {
+		state(prevposition, &KinematicStore::prevposition) = p;
+	}
+	void setVelocity(const Vec &v) { state(velocity, &KinematicStore::velocity) = v; }
+	void setForce(const Vec &f) { state(force, &KinematicStore::force) = f; }
+	void setMass(const double m) { state(mass, &KinematicStore::mass) = m; }
 	void setBaseMass(const double m) { baseMass = m; }
+
+	/**********************************************
+	 *            STRUCTURE OF ARRAYS
+	 **********************************************/
+	KinematicStore *getKinematicStore() const { return kinematics; }
+	size_t getKinematicId() const { return kinematicId; }
+	// moves the state into element id of store s (which must be large enough)
+	void bindKinematics(KinematicStore *s, size_t id) {
+		unbindKinematics();
+		s->position[id] = position;
+		s->prevposition[id] = prevposition;
+		s->velocity[id] = velocity;
+		s->force[id] = force;
+		s->totalForce[id] = totalForce;
+		s->mass[id] = mass;
+		s->movementEnabled[id] = movementEnabled;
+		kinematics = s;
+		kinematicId = id;
+	}
+	// only updates the index, used when the store itself has been reordered
+	void rebindKinematics(size_t id) { kinematicId = id; }
+	// moves the state back into the object's own members
+	void unbindKinematics() {
+		if (kinematics) {
+			position = getPosition();
+			prevposition = getPrevposition();
+			velocity = getVelocity();
+			force = getForce();
+			totalForce = getTotalForce();
+			mass = getMass();
+			movementEnabled = isMovementEnabled();
+			kinematics = nullptr;
+		}
+	}
 	/**********************************************
 	 *                 UPDATES
 	 **********************************************/
 	void receiveForce(const double &intensity, const Vec &direction, const bool &compressive) {
-		force += direction * intensity;
-		totalForce += compressive ? intensity : -intensity;
+		state(force, &KinematicStore::force) += direction * intensity;
+		state(totalForce, &KinematicStore::totalForce) += compressive ? intensity : -intensity;
+	}
+	void receiveForce(const Vec &f) { state(force, &KinematicStore::force) += f; }
+	void receiveTotalForce(const double &t) {
+		state(totalForce, &KinematicStore::totalForce) += t;
 	}
-	void receiveForce(const Vec &f) { force += f; }
-	void resetVelocity() { velocity = Vec::zero(); }
+	void resetVelocity() { state(velocity, &KinematicStore::velocity) = Vec::zero(); }
 	void resetForce() {
-		totalForce = 0;
-		force = Vec::zero();
+		state(totalForce, &KinematicStore::totalForce) = 0;
+		state(force, &KinematicStore::force) = Vec::zero();
 	}
 };
 }
@@ -0,0 +1,129 @@
+#ifndef MECACELL_MULTILEVELGRID_HPP
+#define MECACELL_MULTILEVELGRID_HPP
+#include <vector>
+#include <cmath>
+#include "tools.h"
+#include "mortoncelllist.hpp"
+#include "threadpool.hpp"
+
+using namespace std;
+namespace MecaCell {
+// Hierarchy of cell lists for objects of very different sizes: level l has buckets of
+// baseSize * 2^l, and an object goes in the smallest level whose buckets are at least as
+// large as its diameter. Each object is binned once (by its center, see MortonCellList),
+// so large objects do not fill dozens of buckets and small ones are queried against
+// small buckets. Queries and pair enumeration visit each object / pair once.
+template <typename O> class MultiLevelGrid {
+private:
+	static const size_t MAX_LEVELS = 16;
+
+	double baseSize;
+	vector<MortonCellList<O>> levels;
+	vector<vector<O>> levelContent; // scratch, objects of each level
+
+	size_t levelOf(double radius) const {
+		size_t l = 0;
+		while (l + 1 < MAX_LEVELS && 2.0 * radius > baseSize * pow(2.0, l)) ++l;
+		return l;
+	}
+
+	template <typename Container> void buildWith(const Container &objs, ThreadPool *pool) {
+		for (auto &c : levelContent) c.clear();
+		for (const auto &o : objs) {
+			size_t l = levelOf(ptr(o)->getRadius());
+			if (l >= levelContent.size()) levelContent.resize(l + 1);
+			levelContent[l].push_back(o);
+		}
+		while (levels.size() < levelContent.size())
+			levels.emplace_back(baseSize * pow(2.0, levels.size()));
+		for (size_t l = 0; l < levels.size(); ++l) {
+			if (l < levelContent.size() && pool)
+				levels[l].build(levelContent[l], *pool);
+			else if (l < levelContent.size())
+				levels[l].build(levelContent[l]);
+			else
+				levels[l].clear();
+		}
+	}
+
+public:
+	MultiLevelGrid(double bs) : baseSize(bs) {}
+
+	double getBaseSize() const { return baseSize; }
+	void setBaseSize(double bs) {
+		baseSize = bs;
+		clear();
+	}
+	size_t getNbLevels() const { return levels.size(); }
+	const MortonCellList<O> &getLevel(size_t l) const { return levels[l]; }
+	size_t getNbItems() const {
+		size_t n = 0;
+		for (const auto &l : levels) n += l.getNbItems();
+		return n;
+	}
+
+	void clear() {
+		for (auto &l : levels) l.clear();
+	}
+
+	template <typename Container> void build(const Container &objs) {
+		buildWith(objs, nullptr);
+	}
+	// same result as build(objs), each level being built on pool
+	template <typename Container> void build(const Container &objs, ThreadPool &pool) {
+		buildWith(objs, &pool);
+	}
+
+	// calls f(o) for every object o that can overlap the sphere (coord, r)
+	template <typename F> void forEachNeighbour(const Vec &coord, double r, F f) const {
+		for (const auto &l : levels) l.forEachNeighbour(coord, r, f);
+	}
+
+	template <typename F> void forEachNeighbour(const O &obj, F f) const {
+		forEachNeighbour(ptr(obj)->getPosition(), ptr(obj)->getRadius(), f);
+	}
+
+	vector<O> retrieve(const O &obj) const {
+		vector<O> res;
+		forEachNeighbour(obj, [&](const O &o) { res.push_back(o); });
+		return res;
+	}
+
+	// calls f(a, b) exactly once for every unordered pair of objects that can overlap:
+	// pairs inside a level come from its half shell enumeration. Pairs across levels are
+	// found with one query of the larger levels per bucket of the smaller one (with the
+	// cube enclosing the bucket's objects), the candidates being then filtered with a
+	// sphere test, as large objects are returned by many small buckets
+	template <typename F> void forEachPair(F f) const {
+		for (size_t l = 0; l < levels.size(); ++l) {
+			levels[l].forEachPair(f);
+			size_t nbLarger = 0;
+			for (size_t L = l + 1; L < levels.size(); ++L) nbLarger += levels[L].getNbItems();
+			if (nbLarger == 0) continue;
+			levels[l].forEachBucket([&](const O *begin, const O *end) {
+				Vec lo = ptr(*begin)->getPosition(), hi = lo;
+				for (const O *a = begin; a != end; ++a) {
+					const Vec p = ptr(*a)->getPosition();
+					const double r = ptr(*a)->getRadius();
+					lo = Vec(min(lo.x, p.x - r), min(lo.y, p.y - r), min(lo.z, p.z - r));
+					hi = Vec(max(hi.x, p.x + r), max(hi.y, p.y + r), max(hi.z, p.z + r));
+				}
+				const Vec center = (lo + hi) * 0.5;
+				const double halfSize = max(max(hi.x - lo.x, hi.y - lo.y), hi.z - lo.z) * 0.5;
+				for (size_t L = l + 1; L < levels.size(); ++L)
+					levels[L].forEachBucket(center, halfSize, [&](const O *lb, const O *le) {
+						for (const O *o = lb; o != le; ++o) {
+							const Vec p = ptr(*o)->getPosition();
+							const double r = ptr(*o)->getRadius();
+							for (const O *a = begin; a != end; ++a) {
+								const double d = r + ptr(*a)->getRadius();
+								if ((ptr(*a)->getPosition() - p).sqlength() <= d * d) f(*a, *o);
+							}
+						}
+					});
+			});
+		}
+	}
+};
+}
+#endif
@@ -0,0 +1,113 @@
+#ifndef MECACELL_NEIGHBOURLISTS_HPP
+#define MECACELL_NEIGHBOURLISTS_HPP
+#include <vector>
+#include <algorithm>
+#include "tools.h"
+#include "mortoncelllist.hpp"
+
+using namespace std;
+namespace MecaCell {
+// Verlet neighbour lists: each cell keeps the cells that were closer than the sum of the
+// radii + skin at the last rebuild. A pair that is not listed cannot overlap as long as
+// no cell moved (or grew) by more than skin / 2 since then, so the lists are only rebuilt
+// when that happens, or when cells were added or removed (invalidate()). Displacements
+// are measured from the positions recorded at the last rebuild (a cell's prevposition
+// only goes back one step).
+// Lists are stored in CSR form, in the order of the cells vector, each pair once (in the
+// list of the cell that comes first).
+template <typename Cell> class NeighbourLists {
+private:
+	double skin;
+	MortonCellList<Cell *> cellList = MortonCellList<Cell *>(5.0 * DEFAULT_CELL_RADIUS);
+	vector<Cell *> owners;                  // cells at the last rebuild
+	vector<Vec> refPositions;               // their positions at the last rebuild
+	vector<double> refRadii;                // and radii
+	vector<size_t> offsets;                 // list of owners[i] = [offsets[i], offsets[i+1])
+	vector<Cell *> candidates;
+	vector<pair<size_t, size_t>> pairs;    // scratch: owner id, candidate id
+	vector<pair<Cell *, size_t>> ids;      // scratch, sorted by cell
+	bool valid = false;
+
+	// stats
+	size_t nbUpdates = 0;
+	size_t nbRebuilds = 0;
+	double lastMaxDisplacement = 0;
+
+	void rebuild(const vector<Cell *> &cells) {
+		owners = cells;
+		refPositions.resize(cells.size());
+		refRadii.resize(cells.size());
+		ids.resize(cells.size());
+		for (size_t i = 0; i < cells.size(); ++i) {
+			refPositions[i] = cells[i]->getPosition();
+			refRadii[i] = cells[i]->getRadius();
+			ids[i] = {cells[i], i};
+		}
+		sort(ids.begin(), ids.end());
+		auto id = [&](Cell *c) {
+			return lower_bound(ids.begin(), ids.end(), make_pair(c, size_t(0)))->second;
+		};
+		cellList.build(cells);
+		pairs.clear();
+		cellList.forEachPair(
+		    [&](Cell *a, Cell *b) {
+			    double d = a->getRadius() + b->getRadius() + skin;
+			    if ((a->getPosition() - b->getPosition()).sqlength() <= d * d) {
+				    size_t ia = id(a), ib = id(b);
+				    pairs.push_back({min(ia, ib), max(ia, ib)});
+			    }
+			  },
+		    skin);
+		sort(pairs.begin(), pairs.end());
+		offsets.assign(cells.size() + 1, 0);
+		candidates.resize(pairs.size());
+		for (size_t i = 0; i < pairs.size(); ++i) {
+			++offsets[pairs[i].first + 1];
+			candidates[i] = owners[pairs[i].second];
+		}
+		for (size_t i = 1; i < offsets.size(); ++i) offsets[i] += offsets[i - 1];
+		valid = true;
+		++nbRebuilds;
+	}
+
+public:
+	NeighbourLists(double s) : skin(s) {}
+
+	double getSkin() const { return skin; }
+	void setSkin(double s) {
+		skin = s;
+		invalidate();
+	}
+	// forces a rebuild at the next update (cells were added or removed)
+	void invalidate() { valid = false; }
+
+	size_t getNbUpdates() const { return nbUpdates; }
+	size_t getNbRebuilds() const { return nbRebuilds; }
+	// largest displacement + radius growth since the last rebuild, at the last update
+	double getLastMaxDisplacement() const { return lastMaxDisplacement; }
+	size_t getNbPairs() const { return candidates.size(); }
+	void resetStats() { nbUpdates = nbRebuilds = 0; }
+
+	// rebuilds the lists if needed. Returns true if they were rebuilt
+	bool update(const vector<Cell *> &cells) {
+		++nbUpdates;
+		lastMaxDisplacement = 0;
+		if (valid && cells.size() == owners.size()) {
+			for (size_t i = 0; i < cells.size(); ++i)
+				lastMaxDisplacement = max(lastMaxDisplacement,
+				                          (cells[i]->getPosition() - refPositions[i]).length() +
+				                              max(0.0, cells[i]->getRadius() - refRadii[i]));
+			if (lastMaxDisplacement <= 0.5 * skin) return false;
+		}
+		rebuild(cells);
+		return true;
+	}
+
+	// calls f(a, b) for every listed pair, in the order of the cells vector
+	template <typename F> void forEachPair(F f) const {
+		for (size_t i = 0; i < owners.size(); ++i)
+			for (size_t j = offsets[i]; j < offsets[i + 1]; ++j) f(owners[i], candidates[j]);
+	}
+};
+}
+#endif
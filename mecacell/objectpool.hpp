@@ -0,0 +1,216 @@
+#ifndef MECACELL_OBJECTPOOL_HPP
+#define MECACELL_OBJECTPOOL_HPP
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <type_traits>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+
+using namespace std;
+namespace MecaCell {
+// Slab allocator: objects are constructed in chunks of ChunkSize slots that are never
+// moved nor freed before the pool itself, so addresses are stable.
+// - a free slot holds the links of its chunk's free list, so a slot is exactly the
+//   storage of one T (objects of a chunk are sizeof(T) apart, 8 bytes at least)
+// - a chunk lives in a block aligned on its (power of two) size, starting with the id of
+//   the chunk: the chunk of an object is found by masking its address
+// - the chunks that have free slots are linked together
+// create pops a free slot of an available chunk (a new chunk hands out its slots in
+// address order, then freed slots are reused last in first out) and destroy pushes it
+// back, both in O(1). createNear takes the free slot closest to the hint object in its
+// chunk, to keep related objects together: it is found in a bitmap of the chunk's free
+// slots (at most ChunkSize / 64 words are read) and unlinked in O(1). Nothing is
+// allocated once the pool has grown to the simulation's working size. Objects still
+// alive when the pool is destroyed are not destructed: owners have to destroy them first.
+template <typename T, size_t ChunkSize = 1024> class ObjectPool {
+private:
+	static_assert(ChunkSize > 0 && ChunkSize < 0xffffffffu, "invalid chunk size");
+	static const size_t NONE = static_cast<size_t>(-1);
+	static const uint32_t NIL = 0xffffffffu;
+	static const size_t NB_WORDS = (ChunkSize + 63) / 64;
+	struct Link {
+		uint32_t prev, next; // in the free list of the chunk
+	};
+	union Slot {
+		typename aligned_storage<sizeof(T), alignof(T)>::type object;
+		Link link; // only while the slot is free
+	};
+	static constexpr size_t roundUp(size_t n, size_t a) { return (n + a - 1) / a * a; }
+	static constexpr size_t powerOfTwo(size_t n, size_t p = 1) {
+		return p >= n ? p : powerOfTwo(n, 2 * p);
+	}
+	static constexpr size_t HEADER = roundUp(sizeof(size_t), alignof(Slot)); // chunk id
+	static constexpr size_t BLOCK = powerOfTwo(HEADER + ChunkSize * sizeof(Slot));
+
+	struct Chunk {
+		unique_ptr<char[]> memory; // contains the aligned block
+		char *block = nullptr;
+		uint64_t freeBits[NB_WORDS]; // bit i % 64 of word i / 64 set = slot i is free
+		uint32_t freeHead = NIL;
+		size_t nbFree = 0;
+		size_t prev = NONE, next = NONE; // in the list of chunks with free slots
+		Slot *slots() const { return reinterpret_cast<Slot *>(block + HEADER); }
+	};
+	vector<Chunk> chunks;
+	unordered_set<uintptr_t> blocks; // addresses of the blocks, for owns
+	size_t firstAvailable = NONE;    // head of the list of chunks with free slots
+	size_t nbFree = 0;
+
+	static uintptr_t address(const void *p) { return reinterpret_cast<uintptr_t>(p); }
+
+	// chunk of an object of this pool
+	static size_t chunkOf(const T *obj) {
+		return *reinterpret_cast<const size_t *>(address(obj) & ~(BLOCK - 1));
+	}
+	size_t indexIn(size_t c, const T *obj) const {
+		return (address(obj) - address(chunks[c].slots())) / sizeof(Slot);
+	}
+
+	void link(size_t c) {
+		chunks[c].prev = NONE;
+		chunks[c].next = firstAvailable;
+		if (firstAvailable != NONE) chunks[firstAvailable].prev = c;
+		firstAvailable = c;
+	}
+	void unlink(size_t c) {
+		Chunk &ch = chunks[c];
+		if (ch.prev != NONE) chunks[ch.prev].next = ch.next;
+		else firstAvailable = ch.next;
+		if (ch.next != NONE) chunks[ch.next].prev = ch.prev;
+		ch.prev = ch.next = NONE;
+	}
+
+	void pushFree(Chunk &ch, uint32_t i) {
+		Slot *s = ch.slots();
+		s[i].link.prev = NIL;
+		s[i].link.next = ch.freeHead;
+		if (ch.freeHead != NIL) s[ch.freeHead].link.prev = i;
+		ch.freeHead = i;
+		ch.freeBits[i / 64] |= uint64_t(1) << (i % 64);
+	}
+	// l: links slot i had while it was free
+	void removeFree(Chunk &ch, uint32_t i, const Link &l) {
+		Slot *s = ch.slots();
+		if (l.prev != NIL) s[l.prev].link.next = l.next;
+		else ch.freeHead = l.next;
+		if (l.next != NIL) s[l.next].link.prev = l.prev;
+		ch.freeBits[i / 64] &= ~(uint64_t(1) << (i % 64));
+	}
+
+	void grow() {
+		size_t id = chunks.size();
+		chunks.emplace_back();
+		Chunk &ch = chunks.back();
+		// over allocated so that it contains a block aligned on its size
+		const size_t used = HEADER + ChunkSize * sizeof(Slot);
+		ch.memory.reset(new char[BLOCK - 1 + used]);
+		ch.block = reinterpret_cast<char *>(roundUp(address(ch.memory.get()), BLOCK));
+		*reinterpret_cast<size_t *>(ch.block) = id;
+		blocks.insert(address(ch.block));
+		for (size_t w = 0; w < NB_WORDS; ++w) ch.freeBits[w] = 0;
+		for (size_t i = ChunkSize; i > 0; --i) pushFree(ch, i - 1); // lowest address first
+		ch.nbFree = ChunkSize;
+		nbFree += ChunkSize;
+		link(id);
+	}
+
+	static size_t lowestBit(uint64_t w) { return __builtin_ctzll(w); }
+	static size_t highestBit(uint64_t w) { return 63 - __builtin_clzll(w); }
+
+	// free slot of ch closest to slot i (ch must have one)
+	size_t closestFree(const Chunk &ch, size_t i) const {
+		const size_t w = i / 64, b = i % 64;
+		size_t best = NONE, bestDist = NONE;
+		auto consider = [&](size_t j) {
+			size_t d = j > i ? j - i : i - j;
+			if (d < bestDist) best = j, bestDist = d;
+		};
+		uint64_t above = b == 63 ? 0 : ch.freeBits[w] & (~uint64_t(0) << (b + 1));
+		uint64_t below = ch.freeBits[w] & ((uint64_t(1) << b) - 1);
+		if (above) consider(w * 64 + lowestBit(above));
+		if (below) consider(w * 64 + highestBit(below));
+		for (size_t d = 1; d < NB_WORDS; ++d) {
+			// the slots of the words d away are at least this far
+			size_t upMin = w + d < NB_WORDS ? (w + d) * 64 - i : NONE;
+			size_t downMin = w >= d ? i - ((w - d) * 64 + 63) : NONE;
+			if (bestDist <= min(upMin, downMin)) break;
+			if (w + d < NB_WORDS && ch.freeBits[w + d])
+				consider((w + d) * 64 + lowestBit(ch.freeBits[w + d]));
+			if (w >= d && ch.freeBits[w - d])
+				consider((w - d) * 64 + highestBit(ch.freeBits[w - d]));
+		}
+		return best;
+	}
+
+	template <typename... Args> T *createAt(size_t c, uint32_t i, Args &&... args) {
+		Chunk &ch = chunks[c];
+		Slot &s = ch.slots()[i];
+		const Link l = s.link; // overwritten by the object
+		T *res = new (&s.object) T(std::forward<Args>(args)...);
+		removeFree(ch, i, l);
+		if (--ch.nbFree == 0) unlink(c);
+		--nbFree;
+		return res;
+	}
+
+public:
+	ObjectPool() {}
+	ObjectPool(const ObjectPool &) = delete;
+	ObjectPool &operator=(const ObjectPool &) = delete;
+
+	template <typename... Args> T *create(Args &&... args) {
+		if (firstAvailable == NONE) grow();
+		return createAt(firstAvailable, chunks[firstAvailable].freeHead,
+		                std::forward<Args>(args)...);
+	}
+
+	// same as create, but uses the free slot of hint's chunk closest to hint if there is
+	// one. hint must be an object of this pool (or nullptr)
+	template <typename... Args> T *createNear(const T *hint, Args &&... args) {
+		if (!hint) return create(std::forward<Args>(args)...);
+		assert(owns(hint));
+		size_t c = chunkOf(hint);
+		if (chunks[c].nbFree == 0) return create(std::forward<Args>(args)...);
+		return createAt(c, closestFree(chunks[c], indexIn(c, hint)), std::forward<Args>(args)...);
+	}
+
+	void destroy(T *obj) {
+		assert(owns(obj));
+		size_t c = chunkOf(obj);
+		size_t i = indexIn(c, obj);
+		Chunk &ch = chunks[c];
+		assert(!(ch.freeBits[i / 64] & (uint64_t(1) << (i % 64))));
+		obj->~T();
+		pushFree(ch, i);
+		if (ch.nbFree++ == 0) link(c);
+		++nbFree;
+	}
+
+	bool owns(const T *obj) const {
+		uintptr_t b = address(obj) & ~(BLOCK - 1);
+		if (!blocks.count(b)) return false;
+		uintptr_t offset = address(obj) - b;
+		return offset >= HEADER && (offset - HEADER) % sizeof(Slot) == 0 &&
+		       (offset - HEADER) / sizeof(Slot) < ChunkSize;
+	}
+
+	// stats
+	size_t getNbChunks() const { return chunks.size(); }
+	size_t getCapacity() const { return chunks.size() * ChunkSize; }
+	size_t getNbFree() const { return nbFree; }
+	size_t getNbLive() const { return getCapacity() - getNbFree(); }
+
+	// to be used with unique_ptr
+	struct Deleter {
+		ObjectPool *pool = nullptr;
+		Deleter() {}
+		Deleter(ObjectPool *p) : pool(p) {}
+		void operator()(T *obj) const { pool->destroy(obj); }
+	};
+};
+template <typename T, size_t ChunkSize> constexpr size_t ObjectPool<T, ChunkSize>::HEADER;
+template <typename T, size_t ChunkSize> constexpr size_t ObjectPool<T, ChunkSize>::BLOCK;
+}
+#endif
@@ -0,0 +1,192 @@
+#include "objmodel.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MECACELL_OBJ_MMAP
+#endif
+
+namespace MecaCell {
+namespace {
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+inline void skipBlanks(const char *&p, const char *e) {
+	while (p < e && isBlank(*p)) ++p;
+}
+inline void skipLine(const char *&p, const char *e) {
+	const char *nl = static_cast<const char *>(memchr(p, '\n', e - p));
+	p = nl ? nl + 1 : e;
+}
+
+// decimal number: exact (one rounding) when the mantissa fits in 53 bits and the power of
+// ten is at most 22, strtod otherwise, so that results are the same as with stod
+double parseDouble(const char *&p, const char *e) {
+	static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+	                                1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+	                                1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+	skipBlanks(p, e);
+	const char *start = p;
+	bool neg = false;
+	if (p < e && (*p == '-' || *p == '+')) neg = *p++ == '-';
+	uint64_t mantissa = 0;
+	int nbDigits = 0, exp10 = 0;
+	bool truncated = false;
+	for (; p < e && isDigit(*p); ++p) {
+		if (nbDigits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa) ++nbDigits;
+		} else {
+			++exp10;
+			truncated = true;
+		}
+	}
+	if (p < e && *p == '.') {
+		for (++p; p < e && isDigit(*p); ++p) {
+			if (nbDigits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) ++nbDigits;
+				--exp10;
+			} else {
+				truncated = true;
+			}
+		}
+	}
+	if (p < e && (*p == 'e' || *p == 'E')) {
+		++p;
+		bool negExp = false;
+		if (p < e && (*p == '-' || *p == '+')) negExp = *p++ == '-';
+		int x = 0;
+		for (; p < e && isDigit(*p); ++p) x = x < 10000 ? x * 10 + (*p - '0') : x;
+		exp10 += negExp ? -x : x;
+	}
+	if (!truncated && mantissa < (uint64_t(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+		double v = static_cast<double>(mantissa);
+		v = exp10 < 0 ? v / powers[-exp10] : v * powers[exp10];
+		return neg ? -v : v;
+	}
+	// slow path, on a null terminated copy (the mapped file is not terminated)
+	char buf[128];
+	size_t n = std::min<size_t>(p - start, sizeof(buf) - 1);
+	memcpy(buf, start, n);
+	buf[n] = 0;
+	return strtod(buf, nullptr);
+}
+
+// OBJ index (1 based, or negative = relative to the end) -> 0 based. false if none
+bool parseIndex(const char *&p, const char *e, size_t count, unsigned int &res) {
+	bool neg = false;
+	if (p < e && *p == '-') {
+		neg = true;
+		++p;
+	}
+	if (p >= e || !isDigit(*p)) return false;
+	long long i = 0;
+	for (; p < e && isDigit(*p); ++p) i = i * 10 + (*p - '0');
+	res = static_cast<unsigned int>(neg ? static_cast<long long>(count) - i : i - 1);
+	return true;
+}
+
+// appends t to v, which is kept aligned with faces (padded with 0 triangles)
+void pushAligned(vector<Triangle> &v, size_t faceId, const Triangle &t) {
+	if (v.size() < faceId) v.resize(faceId, Triangle(0, 0, 0));
+	v.push_back(t);
+}
+}
+
+ObjModel::ObjModel(const string &filepath) {
+#ifdef MECACELL_OBJ_MMAP
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			size_t size = static_cast<size_t>(st.st_size);
+			void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED) {
+				madvise(data, size, MADV_SEQUENTIAL);
+				const char *b = static_cast<const char *>(data);
+				parse(b, b + size);
+				munmap(data, size);
+				close(fd);
+				MECACELL_INFO("loaded " << filepath << ": " << vertices.size() << " vertices, "
+				                        << normals.size() << " normals, " << faces.size()
+				                        << " faces");
+				return;
+			}
+		}
+		close(fd);
+	}
+#endif
+	std::ifstream file(filepath, std::ios::binary);
+	string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	parse(content.data(), content.data() + content.size());
+	MECACELL_INFO("loaded " << filepath << ": " << vertices.size() << " vertices, "
+	                        << normals.size() << " normals, " << faces.size() << " faces");
+}
+
+void ObjModel::parse(const char *p, const char *e) {
+	// scratch for the corners of a polygon
+	vector<unsigned int> cv, ct, cn;
+	while (p < e) {
+		skipBlanks(p, e);
+		if (p + 1 < e && p[0] == 'v' && isBlank(p[1])) {
+			++p;
+			double x = parseDouble(p, e);
+			double y = parseDouble(p, e);
+			double z = parseDouble(p, e);
+			vertices.push_back(Vec(x, y, z));
+		} else if (p + 2 < e && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+			p += 2;
+			double u = parseDouble(p, e);
+			double v = parseDouble(p, e);
+			uv.push_back(UV(u, v));
+		} else if (p + 2 < e && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+			p += 2;
+			double x = parseDouble(p, e);
+			double y = parseDouble(p, e);
+			double z = parseDouble(p, e);
+			normals.push_back(Vec(x, y, z));
+		} else if (p + 1 < e && p[0] == 'f' && isBlank(p[1])) {
+			++p;
+			cv.clear();
+			ct.clear();
+			cn.clear();
+			bool hasT = true, hasN = true;
+			for (;;) {
+				skipBlanks(p, e);
+				unsigned int v, t = 0, n = 0;
+				if (!parseIndex(p, e, vertices.size(), v)) break;
+				bool gotT = false, gotN = false;
+				if (p < e && *p == '/') {
+					++p;
+					gotT = parseIndex(p, e, uv.size(), t);
+					if (p < e && *p == '/') {
+						++p;
+						gotN = parseIndex(p, e, normals.size(), n);
+					}
+				}
+				while (p < e && !isBlank(*p) && *p != '\n') ++p; // unexpected characters
+				cv.push_back(v);
+				ct.push_back(t);
+				cn.push_back(n);
+				hasT = hasT && gotT;
+				hasN = hasN && gotN;
+			}
+			// triangle fan
+			for (size_t i = 2; i < cv.size(); ++i) {
+				size_t id = faces.size();
+				faces.push_back(Triangle(cv[0], cv[i - 1], cv[i]));
+				if (hasT) pushAligned(uvFaces, id, Triangle(ct[0], ct[i - 1], ct[i]));
+				if (hasN) pushAligned(normalFaces, id, Triangle(cn[0], cn[i - 1], cn[i]));
+			}
+		}
+		skipLine(p, e);
+	}
+	if (!uvFaces.empty()) uvFaces.resize(faces.size(), Triangle(0, 0, 0));
+	if (!normalFaces.empty()) normalFaces.resize(faces.size(), Triangle(0, 0, 0));
+}
+}
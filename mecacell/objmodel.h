@@ -4,15 +4,10 @@
 #include "tools.h"
 #include <vector>
 #include <array>
-#include <unordered_map>
-#include <fstream>
-#include <sstream>
 #include <string>
-#include <iostream>
 
 using std::vector;
 using std::string;
-using std::unordered_map;
 using std::array;
 
 namespace MecaCell {
@@ -29,42 +24,24 @@ struct Triangle {
 	Triangle(unsigned int I0, unsigned int I1, unsigned int I2) : indices{{I0, I1, I2}} {}
 };
 
+// Triangle mesh loaded from a Wavefront OBJ file (v, vt, vn and f lines; polygons are
+// split into triangle fans, negative indices are relative to the end). Indices are
+// stored in flat arrays of triangles, uvFaces and normalFaces being either empty (no such
+// index in the file) or aligned with faces (0 for the faces that have none).
 class ObjModel {
 public:
 	vector<Vec> vertices;
 	vector<UV> uv;
 	vector<Vec> normals;
-	vector<unordered_map<string, Triangle>> faces;
+	vector<Triangle> faces;       // vertex indices
+	vector<Triangle> uvFaces;     // uv indices
+	vector<Triangle> normalFaces; // normal indices
 
-	ObjModel(const string &filepath) {
-		std::ifstream file(filepath);
-		string line;
-		while (std::getline(file, line)) {
-			vector<string> vs = splitStr(line, ' ');
-			if (vs.size() > 1) {
-				if (vs[0] == "v" && vs.size() > 3) {
-					vertices.push_back(Vec(stod(vs[1]), stod(vs[2]), stod(vs[3])));
-				} else if (vs[0] == "vt" && vs.size() > 2) {
-					uv.push_back(UV(stod(vs[1]), stod(vs[2])));
-				} else if (vs[0] == "vn" && vs.size() > 3) {
-					normals.push_back(Vec(stod(vs[1]), stod(vs[2]), stod(vs[3])));
-				} else if (vs[0] == "f" && vs.size() == 4) {
-					unordered_map<string, Triangle> tf;
-					for (size_t i = 1; i < vs.size(); ++i) {
-						vector<string> index = splitStr(vs[i], '/');
-						if (index.size() == 3) {
-							tf["v"].indices[i - 1] = stoi(index[0]) - 1;
-							if (!index[1].empty()) tf["t"].indices[i - 1] = stoi(index[1]) - 1;
-							tf["n"].indices[i - 1] = stoi(index[2]) - 1;
-						}
-					}
-					faces.push_back(tf);
-				}
-			}
-		}
-		//std::cout << "Object loaded, vertices.size = " << vertices.size() << ", normals.size = " << normals.size()
-							//<< ", faces.size = " << faces.size() << std::endl;
-	}
+	ObjModel() {}
+	// the file is memory mapped (when available) and parsed in place
+	ObjModel(const string &filepath);
+	// parses the content of an OBJ file
+	void parse(const char *begin, const char *end);
 };
 }
 #endif
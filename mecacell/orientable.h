@@ -1,6 +1,7 @@
 #ifndef ORIENTABLE_H
 #define ORIENTABLE_H
 #include "tools.h"
+#include "kinematicstore.hpp"
 namespace MecaCell {
 class Orientable {
  protected:
@@ -9,30 +10,100 @@ class Orientable {
 	Basis<Vec> orientation;
 	Rotation<Vec> orientationRotation;
 
+	// when bound, the state above lives in orientationKinematics at orientationKinematicId
+	KinematicStore* orientationKinematics = nullptr;
+	size_t orientationKinematicId = 0;
+
+	bool orientationBound() const {
+		return MECACELL_STRUCTURE_OF_ARRAYS && orientationKinematics;
+	}
+	// own member, or its counterpart in the store when bound
+	template <typename T> T& state(T& member, vector<T> KinematicStore::*array) {
+		return orientationBound() ? (orientationKinematics->*array)[orientationKinematicId]
+		                          : member;
+	}
+	template <typename T>
+	const T& state(const T& member, vector<T> KinematicStore::*array) const {
+		return orientationBound() ? (orientationKinematics->*array)[orientationKinematicId]
+		                          : member;
+	}
+
  public:
 	/**********************************************
 	 *               CONSTRUCTOR
 	 **********************************************/
 	Orientable(){};
+	// a copy is never bound to the original's store
+	Orientable(const Orientable& o)
+	    : angularVelocity(o.getAngularVelocity()),
+	      torque(o.getTorque()),
+	      orientation(o.getOrientation()),
+	      orientationRotation(o.getOrientationRotation()) {}
+	// copies the values, not the binding: they go wherever this object's state lives
+	Orientable& operator=(const Orientable& o) {
+		if (this != &o) {
+			setAngularVelocity(o.getAngularVelocity());
+			setTorque(o.getTorque());
+			state(orientation, &KinematicStore::orientation) = o.getOrientation();
+			setOrientationRotation(o.getOrientationRotation());
+		}
+		return *this;
+	}
 
 	/**********************************************
 	 *                GET & SET
 	 **********************************************/
-	Vec getAngularVelocity() const { return angularVelocity; }
-	Vec getTorque() const { return torque; }
-	Basis<Vec> getOrientation() const { return orientation; }
-	Rotation<Vec> getOrientationRotation() const { return orientationRotation; }
-	void setAngularVelocity(const Vec& v) { angularVelocity = v; }
-	void setTorque(const Vec& t) { torque = t; }
-	void setOrientationRotation(const Rotation<Vec>& r) { orientationRotation = r; }
+	Vec getAngularVelocity() const {
+		return state(angularVelocity, &KinematicStore::angularVelocity);
+	}
+	Vec getTorque() const { return state(torque, &KinematicStore::torque); }
+	Basis<Vec> getOrientation() const { return state(orientation, &KinematicStore::orientation); }
+	Rotation<Vec> getOrientationRotation() const {
+		return state(orientationRotation, &KinematicStore::orientationRotation);
+	}
+	void setAngularVelocity(const Vec& v) {
+		state(angularVelocity, &KinematicStore::angularVelocity) = v;
+	}
+	void setTorque(const Vec& t) { state(torque, &KinematicStore::torque) = t; }
+	void setOrientationRotation(const Rotation<Vec>& r) {
+		state(orientationRotation, &KinematicStore::orientationRotation) = r;
+	}
+
+	/**********************************************
+	 *            STRUCTURE OF ARRAYS
+	 **********************************************/
+	void bindOrientationKinematics(KinematicStore* s, size_t id) {
+		unbindOrientationKinematics();
+		s->angularVelocity[id] = angularVelocity;
+		s->torque[id] = torque;
+		s->orientation[id] = orientation;
+		s->orientationRotation[id] = orientationRotation;
+		orientationKinematics = s;
+		orientationKinematicId = id;
+	}
+	void rebindOrientationKinematics(size_t id) { orientationKinematicId = id; }
+	void unbindOrientationKinematics() {
+		if (orientationKinematics) {
+			angularVelocity = getAngularVelocity();
+			torque = getTorque();
+			orientation = getOrientation();
+			orientationRotation = getOrientationRotation();
+			orientationKinematics = nullptr;
+		}
+	}
 
 	/**********************************************
 	 *                  UPDATES
 	 **********************************************/
-	void receiveTorque(const Vec& t) { torque += t; }
-	void updateCurrentOrientation() { orientation.updateWithRotation(orientationRotation); }
-	void resetTorque() { torque = Vec::zero(); }
-	void resetAngularVelocity() { angularVelocity = Vec::zero(); }
+	void receiveTorque(const Vec& t) { state(torque, &KinematicStore::torque) += t; }
+	void updateCurrentOrientation() {
+		state(orientation, &KinematicStore::orientation)
+		    .updateWithRotation(state(orientationRotation, &KinematicStore::orientationRotation));
+	}
+	void resetTorque() { state(torque, &KinematicStore::torque) = Vec::zero(); }
+	void resetAngularVelocity() {
+		state(angularVelocity, &KinematicStore::angularVelocity) = Vec::zero();
+	}
 };
 }
 #endif
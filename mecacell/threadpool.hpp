@@ -0,0 +1,129 @@
+#ifndef MECACELL_THREADPOOL_HPP
+#define MECACELL_THREADPOOL_HPP
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+using namespace std;
+namespace MecaCell {
+// Persistent pool of worker threads used to split the world's update phases.
+// A job is a range [0, n) that is statically cut into one contiguous chunk per
+// thread (the calling thread processes the first chunk), so the way a range is split
+// only depends on n and on the number of threads, never on scheduling.
+// parallelFor returns once every chunk has been processed (it acts as a barrier).
+class ThreadPool {
+private:
+	using Job = function<void(size_t, size_t, size_t)>; // (begin, end, threadId)
+
+	vector<thread> workers;
+	mutex m;
+	condition_variable workCond, doneCond;
+	const Job *job = nullptr;
+	size_t jobSize = 0;
+	size_t nbChunks = 0;
+	size_t pending = 0;       // nb of worker chunks not yet processed
+	unsigned int generation = 0; // incremented each time a new job is posted
+	bool stopping = false;
+
+	// minimum nb of items per chunk, below which splitting costs more than it saves
+	size_t grain = 64;
+
+	static void getChunk(size_t n, size_t chunks, size_t chunk, size_t &b, size_t &e) {
+		b = (n * chunk) / chunks;
+		e = (n * (chunk + 1)) / chunks;
+	}
+
+	void workerLoop(size_t id, unsigned int seenGeneration) {
+		while (true) {
+			const Job *j;
+			size_t n, chunks;
+			{
+				unique_lock<mutex> lock(m);
+				workCond.wait(lock, [&] { return stopping || generation != seenGeneration; });
+				if (stopping) return;
+				seenGeneration = generation;
+				j = job;
+				n = jobSize;
+				chunks = nbChunks;
+			}
+			if (id < chunks) {
+				size_t b, e;
+				getChunk(n, chunks, id, b, e);
+				(*j)(b, e, id);
+				unique_lock<mutex> lock(m);
+				if (--pending == 0) doneCond.notify_one();
+			}
+		}
+	}
+
+	void stopWorkers() {
+		{
+			unique_lock<mutex> lock(m);
+			stopping = true;
+		}
+		workCond.notify_all();
+		for (auto &w : workers) w.join();
+		workers.clear();
+		stopping = false;
+	}
+
+public:
+	ThreadPool(size_t n = 1) { setNbThreads(n); }
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+	~ThreadPool() { stopWorkers(); }
+
+	// total nb of threads taking part in a job, including the calling one
+	size_t getNbThreads() const { return workers.size() + 1; }
+	void setNbThreads(size_t n) {
+		if (n == 0) n = max(1u, thread::hardware_concurrency());
+		if (n == getNbThreads()) return;
+		stopWorkers();
+		for (size_t i = 1; i < n; ++i)
+			workers.emplace_back(&ThreadPool::workerLoop, this, i, generation);
+	}
+	size_t getGrain() const { return grain; }
+	void setGrain(size_t g) { grain = max<size_t>(1, g); }
+
+	// nb of chunks a range of size n would be split into
+	size_t getNbChunks(size_t n) const {
+		return max<size_t>(1, min(getNbThreads(), n / grain));
+	}
+
+	// f(begin, end, threadId) is called once per chunk, threadId < getNbChunks(n)
+	template <typename F> void parallelForRanges(size_t n, const F &f) {
+		size_t chunks = getNbChunks(n);
+		if (chunks == 1) {
+			f(0, n, 0);
+			return;
+		}
+		Job j = [&f](size_t b, size_t e, size_t t) { f(b, e, t); };
+		{
+			unique_lock<mutex> lock(m);
+			job = &j;
+			jobSize = n;
+			nbChunks = chunks;
+			pending = chunks - 1;
+			++generation;
+		}
+		workCond.notify_all();
+		size_t b, e;
+		getChunk(n, chunks, 0, b, e);
+		f(b, e, 0);
+		unique_lock<mutex> lock(m);
+		doneCond.wait(lock, [&] { return pending == 0; });
+		job = nullptr;
+	}
+
+	// f(i) is called for each i in [0, n)
+	template <typename F> void parallelFor(size_t n, const F &f) {
+		parallelForRanges(n, [&f](size_t b, size_t e, size_t) {
+			for (size_t i = b; i < e; ++i) f(i);
+		});
+	}
+};
+}
+#endif
@@ -65,7 +65,7 @@ std::pair<bool, Vec> rayInTriangle(const Vec &v0, const Vec &v1, const Vec &v2,
 		            b <= 1.0 + tolerance && 0 - tolerance <= l && l <= 1.0 + tolerance,
 		        a * v0 + b * v1 + l * v2};
 	} else {
-		cerr << "l = " << l << endl;
+		MECACELL_DEBUG("rayInTriangle: no intersection (l = " << l << ")");
 		return {false, o};
 	}
 }
@@ -2,6 +2,7 @@
 #define TOOLS_H
 #include "vector3D.h"
 #include "assert.h"
+#include "logging.h"
 #include <random>
 #include <string>
 #include <vector>
@@ -52,5 +53,14 @@ std::vector<std::string> splitStr(const std::string &s, char delim);
 // return a pointer (transform reference into pointer)
 template <typename T> T *ptr(T &obj) { return &obj; }
 template <typename T> T *ptr(T *obj) { return obj; }
+// strict order on positioned objects: by position, then by address (for equal positions
+// only), so that it does not depend on where objects were allocated
+template <typename O> bool positionOrder(const O &a, const O &b) {
+	const Vec pa = ptr(a)->getPosition(), pb = ptr(b)->getPosition();
+	if (pa.x != pb.x) return pa.x < pb.x;
+	if (pa.y != pb.y) return pa.y < pb.y;
+	if (pa.z != pb.z) return pa.z < pb.z;
+	return ptr(a) < ptr(b);
+}
 }
 #endif
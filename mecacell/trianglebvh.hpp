@@ -0,0 +1,216 @@
+#ifndef MECACELL_TRIANGLEBVH_HPP
+#define MECACELL_TRIANGLEBVH_HPP
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include "tools.h"
+#include "objmodel.h"
+
+using namespace std;
+namespace MecaCell {
+// Bounding volume hierarchy over the triangles of a mesh, built with the surface area
+// heuristic (binned along the largest centroid extent) and stored as a flat array of
+// nodes: the children of an interior node are next to each other, after their parent, and
+// a leaf references a range of triIndices. Queries return each triangle whose bounding
+// box touches the sphere, exactly once.
+// refit() recomputes the boxes when the vertices moved without changing the topology.
+class TriangleBVH {
+public:
+	struct AABB {
+		Vec mn = Vec(numeric_limits<double>::max());
+		Vec mx = Vec(-numeric_limits<double>::max());
+		void grow(const Vec &p) {
+			mn = Vec(min(mn.x, p.x), min(mn.y, p.y), min(mn.z, p.z));
+			mx = Vec(max(mx.x, p.x), max(mx.y, p.y), max(mx.z, p.z));
+		}
+		void grow(const AABB &b) { // (b can be empty)
+			mn = Vec(min(mn.x, b.mn.x), min(mn.y, b.mn.y), min(mn.z, b.mn.z));
+			mx = Vec(max(mx.x, b.mx.x), max(mx.y, b.mx.y), max(mx.z, b.mx.z));
+		}
+		double area() const {
+			Vec d = mx - mn;
+			if (d.x < 0) return 0;
+			return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+		}
+		// squared distance between p and the box (0 inside)
+		double sqDistTo(const Vec &p) const {
+			double dx = max(max(mn.x - p.x, 0.0), p.x - mx.x);
+			double dy = max(max(mn.y - p.y, 0.0), p.y - mx.y);
+			double dz = max(max(mn.z - p.z, 0.0), p.z - mx.z);
+			return dx * dx + dy * dy + dz * dz;
+		}
+	};
+
+	struct Node {
+		AABB box;
+		uint32_t first = 0; // left child (interior node) or first triIndices entry (leaf)
+		uint32_t count = 0; // nb of triangles, 0 for interior nodes
+		bool isLeaf() const { return count > 0; }
+	};
+
+private:
+	static const size_t NB_BINS = 12;
+	static const size_t MAX_LEAF_SIZE = 4;
+	static const size_t MAX_DEPTH = 60; // bounds the traversal stack
+
+	vector<Node> nodes;
+	vector<uint32_t> triIndices;
+	vector<AABB> leafBoxes; // box of the triangle triIndices[i], tested in the leaves
+	// per triangle, only used during build
+	vector<AABB> triBoxes;
+	vector<Vec> centroids;
+
+	static AABB triangleBox(const vector<Vec> &vertices, const Triangle &t) {
+		AABB b;
+		for (const auto &i : t.indices) b.grow(vertices[i]);
+		return b;
+	}
+
+	double coord(const Vec &v, int axis) const {
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	void subdivide(uint32_t n, size_t depth) {
+		const uint32_t first = nodes[n].first, count = nodes[n].count;
+		if (count <= MAX_LEAF_SIZE || depth >= MAX_DEPTH) return;
+		// binned SAH along the largest centroid extent
+		AABB cb;
+		for (uint32_t i = first; i < first + count; ++i) cb.grow(centroids[triIndices[i]]);
+		Vec extent = cb.mx - cb.mn;
+		int axis =
+		    extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		const double lo = coord(cb.mn, axis), size = coord(extent, axis);
+		if (size <= 0) return; // all centroids at the same place
+		AABB binBoxes[NB_BINS];
+		uint32_t binCounts[NB_BINS] = {0};
+		auto binOf = [&](uint32_t t) {
+			size_t b = static_cast<size_t>(NB_BINS * (coord(centroids[t], axis) - lo) / size);
+			return min(b, NB_BINS - 1);
+		};
+		for (uint32_t i = first; i < first + count; ++i) {
+			size_t b = binOf(triIndices[i]);
+			++binCounts[b];
+			binBoxes[b].grow(triBoxes[triIndices[i]]);
+		}
+		// cost of splitting after bin s, from prefix & suffix sweeps
+		double leftArea[NB_BINS - 1], rightArea[NB_BINS - 1];
+		uint32_t leftCount[NB_BINS - 1], rightCount[NB_BINS - 1];
+		AABB l, r;
+		uint32_t lc = 0, rc = 0;
+		for (size_t s = 0; s < NB_BINS - 1; ++s) {
+			l.grow(binBoxes[s]);
+			lc += binCounts[s];
+			leftArea[s] = l.area();
+			leftCount[s] = lc;
+			r.grow(binBoxes[NB_BINS - 1 - s]);
+			rc += binCounts[NB_BINS - 1 - s];
+			rightArea[NB_BINS - 2 - s] = r.area();
+			rightCount[NB_BINS - 2 - s] = rc;
+		}
+		double bestCost = numeric_limits<double>::max();
+		size_t bestSplit = 0;
+		for (size_t s = 0; s < NB_BINS - 1; ++s) {
+			if (leftCount[s] == 0 || rightCount[s] == 0) continue;
+			double cost = leftCount[s] * leftArea[s] + rightCount[s] * rightArea[s];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestSplit = s;
+			}
+		}
+		// not splitting costs count * area of the node
+		if (bestCost >= count * nodes[n].box.area()) return;
+		uint32_t *mid = partition(&triIndices[first], &triIndices[first] + count,
+		                          [&](uint32_t t) { return binOf(t) <= bestSplit; });
+		uint32_t leftSize = static_cast<uint32_t>(mid - &triIndices[first]);
+		if (leftSize == 0 || leftSize == count) return;
+		uint32_t left = nodes.size();
+		nodes.resize(nodes.size() + 2);
+		nodes[left].first = first;
+		nodes[left].count = leftSize;
+		nodes[left + 1].first = first + leftSize;
+		nodes[left + 1].count = count - leftSize;
+		for (uint32_t c = left; c <= left + 1; ++c)
+			for (uint32_t i = nodes[c].first; i < nodes[c].first + nodes[c].count; ++i)
+				nodes[c].box.grow(triBoxes[triIndices[i]]);
+		nodes[n].first = left;
+		nodes[n].count = 0;
+		subdivide(left, depth + 1);
+		subdivide(left + 1, depth + 1);
+	}
+
+public:
+	const vector<Node> &getNodes() const { return nodes; }
+	size_t getNbTriangles() const { return triIndices.size(); }
+	bool empty() const { return triIndices.empty(); }
+
+	void clear() {
+		nodes.clear();
+		triIndices.clear();
+		leafBoxes.clear();
+	}
+
+	void build(const vector<Vec> &vertices, const vector<Triangle> &faces) {
+		clear();
+		if (faces.empty()) return;
+		triBoxes.resize(faces.size());
+		centroids.resize(faces.size());
+		triIndices.resize(faces.size());
+		for (size_t i = 0; i < faces.size(); ++i) {
+			triBoxes[i] = triangleBox(vertices, faces[i]);
+			const auto &f = faces[i].indices;
+			centroids[i] = (vertices[f[0]] + vertices[f[1]] + vertices[f[2]]) / 3.0;
+			triIndices[i] = i;
+		}
+		nodes.reserve(2 * faces.size());
+		nodes.resize(1);
+		nodes[0].first = 0;
+		nodes[0].count = faces.size();
+		for (const auto &b : triBoxes) nodes[0].box.grow(b);
+		subdivide(0, 0);
+		leafBoxes.resize(faces.size());
+		for (size_t i = 0; i < faces.size(); ++i) leafBoxes[i] = triBoxes[triIndices[i]];
+		triBoxes.clear();
+		centroids.clear();
+	}
+
+	// recomputes the boxes for moved vertices (same faces as in build)
+	void refit(const vector<Vec> &vertices, const vector<Triangle> &faces) {
+		// children are always stored after their parent
+		for (size_t n = nodes.size(); n-- > 0;) {
+			Node &node = nodes[n];
+			node.box = AABB();
+			if (node.isLeaf()) {
+				for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+					leafBoxes[i] = triangleBox(vertices, faces[triIndices[i]]);
+					node.box.grow(leafBoxes[i]);
+				}
+			} else {
+				node.box.grow(nodes[node.first].box);
+				node.box.grow(nodes[node.first + 1].box);
+			}
+		}
+	}
+
+	// calls f(faceId) for every triangle whose bounding box intersects the sphere (p, r)
+	template <typename F> void forEachTriangleNear(const Vec &p, double r, F f) const {
+		if (nodes.empty()) return;
+		const double sqr = r * r;
+		uint32_t stack[MAX_DEPTH + 2];
+		size_t top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const Node &node = nodes[stack[--top]];
+			if (node.box.sqDistTo(p) > sqr) continue;
+			if (node.isLeaf()) {
+				for (uint32_t i = node.first; i < node.first + node.count; ++i)
+					if (leafBoxes[i].sqDistTo(p) <= sqr) f(triIndices[i]);
+			} else {
+				stack[top++] = node.first + 1;
+				stack[top++] = node.first;
+			}
+		}
+	}
+};
+}
+#endif
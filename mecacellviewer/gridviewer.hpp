@@ -26,7 +26,7 @@ public:
 		double cellSize = g.getCellSize();
 		for (const auto &c : g.getContent()) {
 			QMatrix4x4 model;
-			model.translate(toQV3D(c.first) * cellSize);
+			model.translate(toQV3D(c.first.toVec()) * cellSize);
 			model.scale(cellSize * 0.5, cellSize * 0.5, cellSize * 0.5);
 			QMatrix4x4 nmatrix = (model).inverted().transposed();
 			shader.setUniformValue(shader.uniformLocation("model"), model);
@@ -17,26 +17,26 @@ template <typename Model> struct ModelViewer {
 	void load(const Model &m) {
 
 		// extracting vertices, normals and uv (if available)
-		for (auto &v : m.vertices) {
+		for (auto &v : m.getVertices()) {
 			vertices.push_back(v.x);
 			vertices.push_back(v.y);
 			vertices.push_back(v.z);
 		}
 		normals.resize(vertices.size());
-		for (auto &f : m.obj.faces) {
-
-			assert(f.count("v") && f.count("n"));
-			for (auto &vid : f.at("v").indices) {
+		const bool hasNormals = !m.obj.normalFaces.empty();
+		for (size_t i = 0; i < m.obj.faces.size(); ++i) {
+			const auto &f = m.obj.faces[i];
+			for (auto &vid : f.indices) {
 				assert(vid < m.obj.vertices.size());
 				indices.push_back(vid);
 			}
 
-			for (int id = 0; id < 3; ++id) {
-				size_t vid = f.at("v").indices[id];
-				size_t nid = f.at("n").indices[id];
-				normals[vid * 3 + 0] = m.normals[nid].x;
-				normals[vid * 3 + 1] = m.normals[nid].y;
-				normals[vid * 3 + 2] = m.normals[nid].z;
+			for (int id = 0; hasNormals && id < 3; ++id) {
+				size_t vid = f.indices[id];
+				size_t nid = m.obj.normalFaces[i].indices[id];
+				normals[vid * 3 + 0] = m.getNormals()[nid].x;
+				normals[vid * 3 + 1] = m.getNormals()[nid].y;
+				normals[vid * 3 + 2] = m.getNormals()[nid].z;
 			}
 		}
 
@@ -0,0 +1,370 @@
+#include "catch.hpp"
+#include "testcell.hpp"
+#include <chrono>
+
+// Benchmarks are hidden test cases, run them with: ./test "[bench]"
+using namespace MecaCell;
+
+template <typename F> double timeMs(F f) {
+	auto t0 = std::chrono::high_resolution_clock::now();
+	f();
+	auto t1 = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+TEST_CASE("Neighbour membership", "[.][bench]") {
+	const size_t nbNeighbours = 24;
+	const size_t nbQueries = 2000000;
+	vector<int> pool(1000);
+	vector<int *> vec;
+	FlatSet<int *> flat;
+	for (size_t i = 0; i < nbNeighbours; ++i) {
+		vec.push_back(&pool[(i * 37) % pool.size()]);
+		flat.insert(&pool[(i * 37) % pool.size()]);
+	}
+	size_t foundVec = 0, foundFlat = 0;
+	double tVec = timeMs([&]() {
+		for (size_t q = 0; q < nbQueries; ++q)
+			foundVec += find(vec.begin(), vec.end(), &pool[q % pool.size()]) != vec.end();
+	});
+	double tFlat = timeMs([&]() {
+		for (size_t q = 0; q < nbQueries; ++q) foundFlat += flat.count(&pool[q % pool.size()]);
+	});
+	REQUIRE(foundVec == foundFlat);
+	cout << "membership, " << nbNeighbours << " neighbours, " << nbQueries
+	     << " queries: vector find = " << tVec << " ms, FlatSet = " << tFlat << " ms" << endl;
+}
+
+TEST_CASE("Cell grid rebuild and query", "[.][bench]") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 20, 50.0);
+	const int nbFrames = 20;
+	Grid<TestCell *> g(5.0 * DEFAULT_CELL_RADIUS);
+	FlatGrid<TestCell *> fg(5.0 * DEFAULT_CELL_RADIUS);
+	size_t foundGrid = 0, foundFlat = 0;
+	double tGrid = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f) {
+			g.clear();
+			for (auto &c : w.cells) g.insert(c);
+			for (auto &c : w.cells) foundGrid += g.retrieve(c).size();
+		}
+	});
+	double tFlat = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f) {
+			fg.clear();
+			for (auto &c : w.cells) fg.insert(c);
+			fg.build();
+			for (auto &c : w.cells) foundFlat += fg.retrieve(c).size();
+		}
+	});
+	REQUIRE(foundFlat > 0);
+	cout << w.cells.size() << " cells, " << nbFrames << " rebuilds + queries: Grid = " << tGrid
+	     << " ms, FlatGrid = " << tFlat << " ms" << endl;
+}
+
+TEST_CASE("Cell grid rebuild", "[.][bench]") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 20, 50.0);
+	const int nbFrames = 50;
+	Grid<TestCell *> g(5.0 * DEFAULT_CELL_RADIUS);
+	MortonCellList<TestCell *> cl(5.0 * DEFAULT_CELL_RADIUS);
+	double tGrid = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f) {
+			g.clear();
+			for (auto &c : w.cells) g.insert(c);
+		}
+	});
+	double tList = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f) cl.build(w.cells);
+	});
+	REQUIRE(cl.getNbItems() == w.cells.size());
+	cout << w.cells.size() << " cells, " << nbFrames << " rebuilds: Grid = " << tGrid
+	     << " ms, MortonCellList = " << tList << " ms" << endl;
+}
+
+TEST_CASE("Incremental grid update", "[.][bench]") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 20, 50.0);
+	for (int i = 0; i < 5; ++i) w.update(); // let the tissue start relaxing
+	const int nbFrames = 50;
+	unsigned int seed = 7;
+	auto rnd = [&]() { // in [0, 1)
+		seed = seed * 1103515245 + 12345;
+		return static_cast<double>((seed >> 8) & 0xffff) / 65536.0;
+	};
+	// each frame, a fraction of the cells moves by up to 10 in each direction
+	for (double fraction : {0.0, 0.01, 0.1}) {
+		Grid<TestCell *> g(5.0 * DEFAULT_CELL_RADIUS), inc(5.0 * DEFAULT_CELL_RADIUS);
+		inc.update(w.cells);
+		size_t nbMoved = 0;
+		double tRebuild = 0, tInc = 0;
+		for (int f = 0; f < nbFrames; ++f) {
+			for (auto &c : w.cells)
+				if (rnd() < fraction)
+					c->setPosition(c->getPosition() +
+					               Vec(rnd() - 0.5, rnd() - 0.5, rnd() - 0.5) * 20.0);
+			tRebuild += timeMs([&]() {
+				g.clear();
+				for (auto &c : w.cells) g.insert(c);
+			});
+			tInc += timeMs([&]() { inc.update(w.cells); });
+			nbMoved += inc.getLastNbMoved();
+		}
+		bool same = true;
+		for (size_t i = 0; i < w.cells.size(); i += 97) {
+			auto a = g.retrieve(w.cells[i]), b = inc.retrieve(w.cells[i]);
+			sort(a.begin(), a.end());
+			sort(b.begin(), b.end());
+			same = same && a == b;
+		}
+		REQUIRE(same);
+		REQUIRE((nbMoved > 0) == (fraction > 0));
+		cout << w.cells.size() << " cells, " << nbFrames << " frames, " << fraction * 100.0
+		     << "% of the cells moving: rebuild = " << tRebuild
+		     << " ms, incremental update = " << tInc << " ms (" << nbMoved / nbFrames
+		     << " cells rebucketed per frame)" << endl;
+	}
+}
+
+TEST_CASE("Neighbour visitor", "[.][bench]") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 20, 50.0);
+	const int nbFrames = 20;
+	Grid<TestCell *> g(5.0 * DEFAULT_CELL_RADIUS);
+	for (auto &c : w.cells) g.insert(c);
+	size_t foundRetrieve = 0, foundVisitor = 0;
+	double tRetrieve = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f)
+			for (auto &c : w.cells)
+				for (auto &c2 : g.retrieve(c)) foundRetrieve += c2 != c;
+	});
+	double tVisitor = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f)
+			for (auto &c : w.cells)
+				g.forEachNeighbour(c, [&](TestCell *c2) { foundVisitor += c2 != c; });
+	});
+	REQUIRE(foundRetrieve == foundVisitor);
+	cout << w.cells.size() << " cells, " << nbFrames << " frames of queries: retrieve = "
+	     << tRetrieve << " ms, forEachNeighbour = " << tVisitor << " ms" << endl;
+}
+
+TEST_CASE("Unique model faces query", "[.][bench]") {
+	TempFile wall("wall.obj");
+	writeWallObj(wall.path(), 400, 10.0); // 320k triangles
+	Model m(wall.path());
+	Grid<pair<Model *, unsigned int>> g(100);
+	for (size_t i = 0; i < m.faces.size(); ++i)
+		g.insert({&m, i}, m.getVertices()[m.faces[i].indices[0]],
+		         m.getVertices()[m.faces[i].indices[1]], m.getVertices()[m.faces[i].indices[2]]);
+	const size_t nbQueries = 20000;
+	auto queryPos = [](size_t q) {
+		return Vec(double(q % 200) * 19.0 - 1900.0, 20.0, double(q / 200) * 38.0 - 1900.0);
+	};
+	size_t foundSet = 0, foundFlat = 0;
+	double tSet = timeMs([&]() {
+		for (size_t q = 0; q < nbQueries; ++q) foundSet += g.retrieveUnique(queryPos(q), 40.0).size();
+	});
+	vector<pair<Model *, unsigned int>> scratch;
+	double tFlat = timeMs([&]() {
+		for (size_t q = 0; q < nbQueries; ++q) {
+			g.retrieveUnique(queryPos(q), 40.0, scratch);
+			foundFlat += scratch.size();
+		}
+	});
+	REQUIRE(foundSet == foundFlat);
+	REQUIRE(foundSet > 0);
+	cout << m.faces.size() << " triangles, " << nbQueries << " queries: std::set = " << tSet
+	     << " ms, flat scratch buffer = " << tFlat << " ms" << endl;
+}
+
+TEST_CASE("Model faces broad phase", "[.][bench]") {
+	TempFile wall("wall.obj");
+	writeWallObj(wall.path(), 400, 10.0); // 320k triangles
+	Model m(wall.path());
+	Grid<pair<Model *, unsigned int>> g(100);
+	TriangleBVH bvh;
+	double tGridBuild = timeMs([&]() {
+		for (size_t i = 0; i < m.faces.size(); ++i)
+			g.insert({&m, i}, m.getVertices()[m.faces[i].indices[0]],
+			         m.getVertices()[m.faces[i].indices[1]], m.getVertices()[m.faces[i].indices[2]]);
+	});
+	double tBVHBuild = timeMs([&]() { bvh.build(m.getVertices(), m.faces); });
+	m.translate(Vec(0, 1, 0));
+	double tRefit = timeMs([&]() { bvh.refit(m.getVertices(), m.faces); });
+	const size_t nbQueries = 20000;
+	auto queryPos = [](size_t q) {
+		return Vec(double(q % 200) * 19.0 - 1900.0, 21.0, double(q / 200) * 38.0 - 1900.0);
+	};
+	size_t foundGrid = 0, foundBVH = 0;
+	vector<pair<Model *, unsigned int>> scratch;
+	double tGrid = timeMs([&]() {
+		for (size_t q = 0; q < nbQueries; ++q) {
+			g.retrieveUnique(queryPos(q), 40.0, scratch);
+			foundGrid += scratch.size();
+		}
+	});
+	double tBVH = timeMs([&]() {
+		for (size_t q = 0; q < nbQueries; ++q)
+			bvh.forEachTriangleNear(queryPos(q), 40.0, [&](uint32_t) { ++foundBVH; });
+	});
+	REQUIRE(foundBVH > 0);
+	cout << m.faces.size() << " triangles: grid build = " << tGridBuild
+	     << " ms, BVH build = " << tBVHBuild << " ms, BVH refit = " << tRefit << " ms" << endl;
+	cout << nbQueries << " queries: grid = " << tGrid << " ms (" << foundGrid
+	     << " candidates), BVH = " << tBVH << " ms (" << foundBVH << " candidates)" << endl;
+}
+
+TEST_CASE("Wall contacts", "[.][bench]") {
+	TempFile wall("wall.obj");
+	writeWallObj(wall.path(), 100, 30.0);
+	BasicWorld<TestCell, Euler> w;
+	w.addModel("wall", wall.path());
+	w.disableCellCellCollisions();
+	for (int i = 0; i < 60; ++i)
+		for (int k = 0; k < 60; ++k)
+			w.addCell(new TestCell(Vec(i * 45.0 - 1350.0, 30.0, k * 45.0 - 1350.0)));
+	w.update();
+	const int nbFrames = 50;
+	double t = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f) w.update();
+	});
+	size_t nbContacts = 0;
+	for (auto &c : w.cells) nbContacts += c->getRWModelConnections().size();
+	REQUIRE(nbContacts > 0);
+	cout << w.cells.size() << " cells, " << nbContacts << " cell-model connections, "
+	     << nbFrames << " frames = " << t << " ms" << endl;
+}
+
+TEST_CASE("Moving wall", "[.][bench]") {
+	TempFile wall("wall.obj");
+	writeWallObj(wall.path(), 300, 10.0); // 180k triangles
+	const int nbFrames = 20;
+	double t[2];
+	for (int phase = 0; phase < 2; ++phase) {
+		BasicWorld<TestCell, Euler> w;
+		w.addModel("wall", wall.path());
+		w.disableCellCellCollisions();
+		if (phase == 1) w.setModelBroadPhase(ModelBroadPhase::bvh);
+		for (int i = 0; i < 30; ++i)
+			for (int k = 0; k < 30; ++k)
+				w.addCell(new TestCell(Vec(i * 45.0 - 675.0, 30.0, k * 45.0 - 675.0)));
+		w.update();
+		t[phase] = timeMs([&]() {
+			for (int f = 0; f < nbFrames; ++f) {
+				w.models.at("wall").translate(Vec(0, 0.2, 0));
+				w.update();
+			}
+		});
+	}
+	cout << "180k triangles moving every frame, 900 cells, " << nbFrames
+	     << " frames: world space grid = " << t[0] << " ms, model space BVH = " << t[1] << " ms"
+	     << endl;
+}
+
+TEST_CASE("OBJ loading time", "[.][bench]") {
+	TempFile big("big.obj");
+	writeWallObj(big.path(), 1000, 1.0); // 2M triangles
+	// previous loader: getline + splitStr + stod, one map per face
+	vector<Vec> refVertices;
+	vector<Triangle> refFaces;
+	double tLines = timeMs([&]() {
+		ifstream file(big.path());
+		string line;
+		while (getline(file, line)) {
+			vector<string> vs = splitStr(line, ' ');
+			if (vs.size() > 3 && vs[0] == "v") {
+				refVertices.push_back(Vec(stod(vs[1]), stod(vs[2]), stod(vs[3])));
+			} else if (vs.size() == 4 && vs[0] == "f") {
+				unordered_map<string, Triangle> tf;
+				for (size_t i = 1; i < vs.size(); ++i) {
+					vector<string> index = splitStr(vs[i], '/');
+					tf["v"].indices[i - 1] = stoi(index[0]) - 1;
+					tf["n"].indices[i - 1] = stoi(index[2]) - 1;
+				}
+				refFaces.push_back(tf.at("v"));
+			}
+		}
+	});
+	unique_ptr<ObjModel> o;
+	double tFast = timeMs([&]() { o.reset(new ObjModel(big.path())); });
+	bool same = o->vertices.size() == refVertices.size() && o->faces.size() == refFaces.size();
+	for (size_t i = 0; same && i < refVertices.size(); ++i) same = o->vertices[i] == refVertices[i];
+	for (size_t i = 0; same && i < refFaces.size(); ++i)
+		same = o->faces[i].indices == refFaces[i].indices;
+	REQUIRE(same);
+	cout << o->faces.size() << " triangles: line by line = " << tLines
+	     << " ms, mapped flat loader = " << tFast << " ms" << endl;
+}
+
+TEST_CASE("Mixed radii broad phase", "[.][bench]") {
+	// both broad phases are timed through the world's own collision detection
+	BasicWorld<TestCell, Euler> wGrid, wMulti;
+	for (auto *w : {&wGrid, &wMulti}) {
+		fillLattice(*w, 20, 50.0);
+		for (size_t i = 0; i < w->cells.size(); i += 50) w->cells[i]->setRadius(300.0);
+		w->setG(Vec::zero());
+	}
+	wMulti.setBroadPhase(BroadPhase::multiLevel);
+	wGrid.update();
+	wMulti.update();
+	const int nbFrames = 10;
+	auto collisions = [&](BasicWorld<TestCell, Euler> &w) {
+		return timeMs([&]() {
+			for (int f = 0; f < nbFrames; ++f) {
+				w.updateCellGrid();
+				w.cellCollisions();
+			}
+		});
+	};
+	double tGrid = collisions(wGrid);
+	double tMulti = collisions(wMulti);
+	REQUIRE(wMulti.connections.size() > 0);
+	cout << wGrid.cells.size() << " cells (2% of radius 300), " << nbFrames
+	     << " frames of updateCellGrid + cellCollisions: Grid = " << tGrid << " ms ("
+	     << wGrid.connections.size() << " connections), MultiLevelGrid = " << tMulti << " ms ("
+	     << wMulti.connections.size() << " connections)" << endl;
+}
+
+TEST_CASE("Parallel cell list build time", "[.][bench]") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 60, 50.0);
+	const int nbFrames = 10;
+	ThreadPool pool(0);
+	MortonCellList<TestCell *> cl(5.0 * DEFAULT_CELL_RADIUS);
+	double tSerial = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f) cl.build(w.cells);
+	});
+	double tParallel = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f) cl.build(w.cells, pool);
+	});
+	REQUIRE(cl.getNbItems() == w.cells.size());
+	cout << w.cells.size() << " cells, " << nbFrames << " builds: serial = " << tSerial
+	     << " ms, " << pool.getNbThreads() << " threads = " << tParallel << " ms" << endl;
+}
+
+TEST_CASE("Cell reordering on a large aggregate", "[.][bench]") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 60, 50.0);
+	// cells created in a random order, like after many divisions
+	unsigned int seed = 7;
+	for (size_t i = w.cells.size() - 1; i > 0; --i) {
+		seed = seed * 1103515245 + 12345;
+		swap(w.cells[i], w.cells[(seed >> 8) % (i + 1)]);
+	}
+	w.setStructureOfArrays(MECACELL_STRUCTURE_OF_ARRAYS);
+	w.setBroadPhase(BroadPhase::cellList);
+	w.update(); // creates the connections
+	const int nbFrames = 3;
+	double localityBefore = w.computeLocality();
+	double tShuffled = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f) w.update();
+	});
+	double tReorder = timeMs([&]() { w.reorderCells(); });
+	double tSorted = timeMs([&]() {
+		for (int f = 0; f < nbFrames; ++f) w.update();
+	});
+	REQUIRE(w.getLocality() < localityBefore);
+	cout << w.cells.size() << " cells, " << nbFrames << " updates: creation order = " << tShuffled
+	     << " ms (locality " << localityBefore << "), Z-order = " << tSorted << " ms (locality "
+	     << w.getLocality() << "), reordering = " << tReorder << " ms" << endl;
+}
@@ -1,6 +1,7 @@
 #include "../mecacell/mecacell.h"
 #define CATCH_CONFIG_MAIN // This tells Catch to provide a main() - only do this in one cpp file
 #include "catch.hpp"
+#include "testcell.hpp"
 
 using namespace MecaCell;
 
@@ -21,3 +22,790 @@ TEST_CASE("Trigo, vectors & rotations") {
 	REQUIRE(doubleEq(closestDistToTriangleEdge(a, b, c, Vec(-7, -6.3, 2)), 1.3));
 	REQUIRE(doubleEq(closestDistToTriangleEdge(a, b, c, Vec(-7, -6.3, 3)), sqrt(1.0 + 1.3 * 1.3)));
 }
+
+TEST_CASE("Multithreaded update") {
+	using World = BasicWorld<TestCell, Euler>;
+	World serial, parallel;
+	fillLattice(serial, 8);
+	fillLattice(parallel, 8);
+	parallel.setNbThreads(4);
+	parallel.setParallelCellStats(true); // the default updateStats only writes its cell
+	REQUIRE(parallel.getNbThreads() == 4);
+	for (int i = 0; i < 20; ++i) {
+		serial.update();
+		parallel.update();
+	}
+	REQUIRE(serial.connections.size() > 0);
+	REQUIRE(serial.connections.size() == parallel.connections.size());
+	REQUIRE(serial.cells.size() == parallel.cells.size());
+	bool same = true;
+	for (size_t i = 0; i < serial.cells.size(); ++i)
+		same = same && serial.cells[i]->getPosition() == parallel.cells[i]->getPosition() &&
+		       serial.cells[i]->getVelocity() == parallel.cells[i]->getVelocity();
+	REQUIRE(same);
+}
+
+TEST_CASE("Buffered connection forces") {
+	using World = BasicWorld<TestCell, Euler>;
+	World serial, buffered1, buffered4;
+	for (World *w : {&serial, &buffered1, &buffered4}) fillLattice(*w, 8, 50.0);
+	buffered1.setForceAssembly(ForceAssembly::buffered);
+	buffered4.setForceAssembly(ForceAssembly::buffered);
+	buffered4.setNbThreads(4);
+	for (int i = 0; i < 20; ++i) {
+		serial.update();
+		buffered1.update();
+		buffered4.update();
+	}
+	REQUIRE(serial.connections.size() > 0);
+	bool deterministic = true;
+	double maxDist = 0;
+	for (size_t i = 0; i < serial.cells.size(); ++i) {
+		deterministic =
+		    deterministic && buffered1.cells[i]->getPosition() == buffered4.cells[i]->getPosition();
+		maxDist = max(maxDist, (serial.cells[i]->getPosition() - buffered1.cells[i]->getPosition())
+		                           .length());
+	}
+	REQUIRE(deterministic);
+	REQUIRE(maxDist < 1e-6);
+}
+
+TEST_CASE("Coloured connection batches") {
+	using World = BasicWorld<TestCell, Euler>;
+	World serial, coloured;
+	fillLattice(serial, 8, 50.0);
+	fillLattice(coloured, 8, 50.0);
+	coloured.setForceAssembly(ForceAssembly::coloured);
+	coloured.setNbThreads(4);
+	for (int i = 0; i < 20; ++i) {
+		serial.update();
+		coloured.update();
+	}
+	double maxDist = 0;
+	for (size_t i = 0; i < serial.cells.size(); ++i)
+		maxDist = max(maxDist,
+		              (serial.cells[i]->getPosition() - coloured.cells[i]->getPosition()).length());
+	REQUIRE(maxDist < 1e-6);
+
+	coloured.cells[0]->die();
+	coloured.update();
+	const auto &colouring = coloured.getColouring();
+	REQUIRE(colouring.size() == coloured.connections.size());
+	REQUIRE(colouring.getNbColours() > 1);
+	bool valid = true;
+	for (auto &batch : colouring.getBatches()) {
+		set<TestCell *> nodes;
+		for (auto &c : batch)
+			valid = valid && nodes.insert(c->getNode0()).second && nodes.insert(c->getNode1()).second;
+	}
+	REQUIRE(valid);
+
+	// mass removal: colours are compacted before the next force computation
+	for (size_t i = 0; i < coloured.cells.size(); i += 2) coloured.cells[i]->die();
+	coloured.update();
+	coloured.update();
+	REQUIRE(colouring.size() == coloured.connections.size());
+	REQUIRE(colouring.getBatches().size() == colouring.getNbColours());
+}
+
+struct OpenWorld : public BasicWorld<TestCell, Euler> {
+	using BasicWorld::connectionPool;
+};
+
+TEST_CASE("Coloured batches after external changes") {
+	OpenWorld w;
+	fillLattice(w, 6, 50.0);
+	w.setForceAssembly(ForceAssembly::coloured);
+	for (int i = 0; i < 5; ++i) w.update();
+	// replace a connection by a new one between the same cells: same nb of connections
+	auto *old = w.connections[0];
+	TestCell *c0 = old->getNode0(), *c1 = old->getNode1();
+	c0->removeConnection(c1, old);
+	w.connections.erase(w.connections.begin());
+	size_t nbConnections = w.connections.size();
+	c0->connection(c1, w.connections, w.connectionPool);
+	REQUIRE(w.connections.size() == nbConnections + 1);
+	w.connectionPool.destroy(old);
+	w.connectionsModified();
+	w.update();
+	const auto &colouring = w.getColouring();
+	REQUIRE(colouring.size() == w.connections.size());
+	bool registered = true;
+	for (auto &c : w.connections) registered = registered && colouring.contains(c);
+	REQUIRE(registered);
+}
+
+#if MECACELL_STRUCTURE_OF_ARRAYS
+TEST_CASE("Structure of arrays kinematic storage") {
+	using World = BasicWorld<TestCell, Verlet>;
+	World aos, soa;
+	fillLattice(aos, 6, 50.0);
+	fillLattice(soa, 6, 50.0);
+	soa.setStructureOfArrays(true);
+	soa.setNbThreads(2);
+	REQUIRE(soa.getKinematicStore().size() == soa.cells.size());
+	for (int i = 0; i < 20; ++i) {
+		if (i == 5) {
+			aos.cells[3]->die();
+			soa.cells[3]->die();
+		}
+		if (i == 10) {
+			aos.addCell(new TestCell(Vec(-30, 0, 0)));
+			soa.addCell(new TestCell(Vec(-30, 0, 0)));
+		}
+		aos.update();
+		soa.update();
+	}
+	REQUIRE(soa.getKinematicStore().size() == soa.cells.size());
+	bool same = true;
+	for (size_t i = 0; i < aos.cells.size(); ++i)
+		same = same && soa.cells[i]->getKinematicId() == i &&
+		       aos.cells[i]->getPosition() == soa.cells[i]->getPosition() &&
+		       aos.cells[i]->getOrientationRotation().n == soa.cells[i]->getOrientationRotation().n;
+	REQUIRE(same);
+	Vec p = soa.cells[0]->getPosition();
+	// assignment copies the values, not the binding
+	TestCell copy(Vec(0, 0, 0));
+	copy = *soa.cells[0];
+	REQUIRE(copy.getKinematicStore() == nullptr);
+	REQUIRE(copy.getPosition() == p);
+	copy.setPosition(Vec(1, 2, 3));
+	REQUIRE(soa.cells[0]->getPosition() == p);
+	soa.setStructureOfArrays(false);
+	REQUIRE(soa.cells[0]->getKinematicStore() == nullptr);
+	REQUIRE(soa.cells[0]->getPosition() == p);
+}
+#endif
+
+TEST_CASE("Object pool") {
+	ObjectPool<Vec, 4> pool;
+	vector<Vec *> v;
+	for (int i = 0; i < 6; ++i) v.push_back(pool.create(i, 0, 0));
+	REQUIRE(pool.getNbChunks() == 2);
+	REQUIRE(pool.getNbLive() == 6);
+	REQUIRE(pool.getNbFree() == 2);
+	Vec *third = v[2];
+	pool.destroy(third);
+	REQUIRE(pool.getNbLive() == 5);
+	REQUIRE(pool.create(7, 7, 7) == third); // freed slots are reused first
+	REQUIRE(v[5]->x == 5);
+	Vec outside;
+	REQUIRE(pool.owns(v[5]));
+	REQUIRE(!pool.owns(&outside));
+
+	// createNear takes the free slot closest to its hint
+	ObjectPool<Vec, 256> big;
+	vector<Vec *> all;
+	for (int i = 0; i < 256; ++i) all.push_back(big.create(i, 0, 0));
+	big.destroy(all[10]);
+	big.destroy(all[100]);
+	big.destroy(all[200]);
+	REQUIRE(big.createNear(all[90], 0, 0, 0) == all[100]);
+	REQUIRE(big.createNear(all[20], 0, 0, 0) == all[10]);
+	REQUIRE(big.createNear(all[0], 0, 0, 0) == all[200]);
+	REQUIRE(big.getNbFree() == 0);
+
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 5, 50.0);
+	for (int i = 0; i < 5; ++i) w.update();
+	w.cells[0]->die();
+	w.update();
+	REQUIRE(w.connections.size() > 0);
+	REQUIRE(w.getConnectionPool().getNbLive() == w.connections.size());
+}
+
+TEST_CASE("Pooled cells") {
+	BasicWorld<TestCell, Euler> w;
+	for (int i = 0; i < 10; ++i) w.newCell(Vec(i * 100.0, 0, 0));
+	w.addCell(new TestCell(Vec(0, 100, 0)));
+	REQUIRE(w.getCellPool().getNbLive() == 10);
+	w.cells[2]->die();
+	w.cells[10]->die();
+	w.update();
+	REQUIRE(w.cells.size() == 9);
+	REQUIRE(w.getCellPool().getNbLive() == 9);
+	// the pool hands out the slots of a new chunk in address order, and createNear takes
+	// the free slot closest to its hint: the daughter takes the slot freed by the dead
+	// cell, right after her mother's
+	TestCell *mother = w.cells[1];
+	TestCell *daughter = mother->divide();
+	w.addCell(daughter);
+	REQUIRE(daughter->isPooled());
+	REQUIRE(w.getCellPool().getNbLive() == 10);
+	REQUIRE(abs(reinterpret_cast<char *>(daughter) - reinterpret_cast<char *>(mother)) ==
+	        sizeof(TestCell));
+}
+
+TEST_CASE("Mass cell death") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 8, 50.0);
+	w.setStructureOfArrays(MECACELL_STRUCTURE_OF_ARRAYS);
+	w.setForceAssembly(ForceAssembly::coloured);
+	for (int i = 0; i < 5; ++i) w.update();
+	for (size_t i = 0; i < w.cells.size(); i += 2) w.cells[i]->die();
+	w.update();
+	REQUIRE(w.cells.size() == 256);
+	REQUIRE(w.getConnectionPool().getNbLive() == w.connections.size());
+	REQUIRE(w.getColouring().size() == w.connections.size());
+	bool consistent = true;
+	set<TestCell *> alive(w.cells.begin(), w.cells.end());
+	size_t nbLinks = 0;
+	for (auto &c : w.cells) {
+		nbLinks += c->getRWConnections().size();
+		consistent = consistent && c->getConnectedCells().size() == c->getRWConnections().size();
+		for (auto &other : c->getConnectedCells()) consistent = consistent && alive.count(other);
+	}
+	for (auto &con : w.connections)
+		consistent = consistent && alive.count(con->getNode0()) && alive.count(con->getNode1());
+	REQUIRE(consistent);
+	REQUIRE(nbLinks == 2 * w.connections.size());
+}
+
+TEST_CASE("Flat set") {
+	FlatSet<int> s;
+	REQUIRE(s.insert(3));
+	REQUIRE(s.insert(1));
+	REQUIRE(!s.insert(3));
+	REQUIRE(s.insert(2));
+	REQUIRE(s.getVector() == vector<int>({1, 2, 3}));
+	REQUIRE(s.count(2) == 1);
+	REQUIRE(s.erase(2));
+	REQUIRE(!s.erase(2));
+	REQUIRE(s.count(2) == 0);
+	REQUIRE(s.size() == 2);
+}
+
+TEST_CASE("Flat grid") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 6, 50.0);
+	FlatGrid<TestCell *> fg(5.0 * DEFAULT_CELL_RADIUS);
+	for (int pass = 0; pass < 2; ++pass) { // second pass checks clear()
+		fg.clear();
+		for (auto &c : w.cells) fg.insert(c);
+		fg.build();
+		bool complete = true;
+		for (auto &a : w.cells) {
+			auto found = fg.retrieve(a);
+			for (auto &b : w.cells)
+				if ((a->getPosition() - b->getPosition()).length() < a->getRadius() + b->getRadius())
+					complete = complete && find(found.begin(), found.end(), b) != found.end();
+		}
+		REQUIRE(complete);
+	}
+	// same buckets as Grid: same candidates, duplicates included
+	Grid<TestCell *> g(5.0 * DEFAULT_CELL_RADIUS);
+	for (auto &c : w.cells) g.insert(c);
+	bool sameBuckets = true;
+	for (auto &a : w.cells) {
+		auto fromFlat = fg.retrieve(a), fromGrid = g.retrieve(a);
+		sort(fromFlat.begin(), fromFlat.end());
+		sort(fromGrid.begin(), fromGrid.end());
+		sameBuckets = sameBuckets && fromFlat == fromGrid;
+	}
+	REQUIRE(sameBuckets);
+	BasicWorld<TestCell, Euler> hashed, flat;
+	fillLattice(hashed, 6, 50.0);
+	fillLattice(flat, 6, 50.0);
+	flat.setBroadPhase(BroadPhase::flatGrid);
+	hashed.update();
+	flat.update();
+	REQUIRE(flat.getFlatCellGrid().getNbItems() >= flat.cells.size());
+	REQUIRE(hashed.connections.size() == flat.connections.size());
+}
+
+TEST_CASE("Morton cell list") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 6, 50.0);
+	MortonCellList<TestCell *> cl(5.0 * DEFAULT_CELL_RADIUS);
+	cl.build(w.cells);
+	vector<TestCell *> sorted = cl.getSortedOrder(), orig = w.cells;
+	sort(sorted.begin(), sorted.end());
+	sort(orig.begin(), orig.end());
+	REQUIRE(sorted == orig);
+	bool complete = true, unique = true;
+	for (auto &a : w.cells) {
+		auto found = cl.retrieve(a);
+		set<TestCell *> s(found.begin(), found.end());
+		unique = unique && s.size() == found.size();
+		for (auto &b : w.cells)
+			if ((a->getPosition() - b->getPosition()).length() < a->getRadius() + b->getRadius())
+				complete = complete && s.count(b);
+	}
+	REQUIRE(complete);
+	REQUIRE(unique);
+	set<pair<TestCell *, TestCell *>> pairs;
+	bool once = true;
+	cl.forEachPair([&](TestCell *a, TestCell *b) {
+		once = once && a != b && pairs.insert({min(a, b), max(a, b)}).second;
+	});
+	REQUIRE(once);
+	bool allPairs = true;
+	for (size_t i = 0; i < w.cells.size(); ++i)
+		for (size_t j = i + 1; j < w.cells.size(); ++j) {
+			TestCell *a = w.cells[i], *b = w.cells[j];
+			if ((a->getPosition() - b->getPosition()).length() < a->getRadius() + b->getRadius())
+				allPairs = allPairs && pairs.count({min(a, b), max(a, b)});
+		}
+	REQUIRE(allPairs);
+	// pairs are tested in Z-order, and connection() depends on the previous connections,
+	// so only check that the result is sane
+	BasicWorld<TestCell, Euler> listed;
+	fillLattice(listed, 6, 50.0);
+	listed.setBroadPhase(BroadPhase::cellList);
+	listed.update();
+	REQUIRE(listed.connections.size() > 0);
+	bool overlapping = true;
+	for (auto &con : listed.connections)
+		overlapping = overlapping && con->getLength() <= con->getNode0()->getRadius() +
+		                                                     con->getNode1()->getRadius();
+	REQUIRE(overlapping);
+}
+
+TEST_CASE("Incremental grid") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 6, 50.0);
+	w.setIncrementalGrid(true);
+	auto sameContent = [](const Grid<TestCell *> &a, const Grid<TestCell *> &b) {
+		if (a.getContent().size() != b.getContent().size()) return false;
+		for (auto &bucket : a.getContent()) {
+			if (!b.getContent().count(bucket.first)) return false;
+			set<TestCell *> sa(bucket.second.begin(), bucket.second.end()),
+			    sb(b.getContent().at(bucket.first).begin(), b.getContent().at(bucket.first).end());
+			if (sa != sb || bucket.second.size() != b.getContent().at(bucket.first).size())
+				return false;
+		}
+		return true;
+	};
+	bool same = true;
+	for (int i = 0; i < 30; ++i) {
+		if (i == 10)
+			for (size_t j = 0; j < w.cells.size(); j += 7) w.cells[j]->die();
+		w.update();
+		// dead cells are only removed from the grid at its next update
+		if (i == 10) continue;
+		Grid<TestCell *> fresh(w.getCellGrid().getCellSize());
+		for (auto &c : w.cells) fresh.insert(c);
+		same = same && sameContent(w.getCellGrid(), fresh);
+	}
+	REQUIRE(same);
+	REQUIRE(!w.getCellGrid().getLastUpdateWasRebuild());
+	REQUIRE(w.getCellGrid().getLastNbMoved() < w.cells.size());
+}
+
+TEST_CASE("Neighbour lists") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 6, 50.0);
+	w.setUseNeighbourLists(true);
+	w.setNeighbourSkin(20.0);
+	MortonCellList<TestCell *> cl(5.0 * DEFAULT_CELL_RADIUS);
+	bool allListed = true;
+	for (int i = 0; i < 30; ++i) {
+		if (i == 10)
+			for (size_t j = 0; j < w.cells.size(); j += 7) w.cells[j]->die();
+		w.update();
+		// every overlapping pair has to be in the lists
+		set<pair<TestCell *, TestCell *>> listed;
+		w.getNeighbourLists().forEachPair(
+		    [&](TestCell *a, TestCell *b) { listed.insert({min(a, b), max(a, b)}); });
+		cl.build(w.cells);
+		cl.forEachPair([&](TestCell *a, TestCell *b) {
+			if ((a->getPosition() - b->getPosition()).length() < a->getRadius() + b->getRadius())
+				allListed = allListed && listed.count({min(a, b), max(a, b)});
+		});
+	}
+	REQUIRE(allListed);
+	REQUIRE(w.connections.size() > 0);
+	REQUIRE(w.getNeighbourLists().getNbUpdates() == 30);
+	REQUIRE(w.getNeighbourLists().getNbRebuilds() < 30);
+}
+
+TEST_CASE("Grid index") {
+	set<uint64_t> keys;
+	set<size_t> hashes;
+	for (int i = -10; i <= 10; ++i)
+		for (int j = -10; j <= 10; ++j)
+			for (int k = -10; k <= 10; ++k) {
+				keys.insert(GridIndex(i, j, k).pack());
+				hashes.insert(std::hash<GridIndex>()(GridIndex(i, j, k)));
+			}
+	REQUIRE(keys.size() == 21 * 21 * 21);
+	REQUIRE(hashes.size() == 21 * 21 * 21);
+	REQUIRE(GridIndex(1, -2, 3) + GridIndex(-1, 2, -3) == GridIndex());
+	Grid<TestCell *> g(100.0);
+	TestCell c(Vec(-150, 50, 250)); // radius 40
+	g.insert(&c);
+	REQUIRE(g.getContent().size() == 8);
+	REQUIRE(g.getContent().count(GridIndex(-2, 0, 2)) == 1);
+	REQUIRE(g.retrieveUnique(Vec(-150, 50, 250), 1.0).size() == 1);
+}
+
+TEST_CASE("Unique grid query") {
+	TempFile wall("wall.obj");
+	writeWallObj(wall.path(), 20, 10.0);
+	Model m(wall.path());
+	REQUIRE(m.faces.size() == 800);
+	Grid<pair<Model *, unsigned int>> g(30);
+	for (size_t i = 0; i < m.faces.size(); ++i)
+		g.insert({&m, i}, m.getVertices()[m.faces[i].indices[0]],
+		         m.getVertices()[m.faces[i].indices[1]], m.getVertices()[m.faces[i].indices[2]]);
+	vector<pair<Model *, unsigned int>> scratch;
+	bool same = true;
+	for (double x = -100; x <= 100; x += 17) {
+		auto s = g.retrieveUnique(Vec(x, 5, 0.5 * x), 25.0);
+		g.retrieveUnique(Vec(x, 5, 0.5 * x), 25.0, scratch);
+		same = same && !s.empty() && vector<pair<Model *, unsigned int>>(s.begin(), s.end()) == scratch;
+	}
+	REQUIRE(same);
+}
+
+TEST_CASE("Model BVH") {
+	TempFile wall("wall.obj");
+	writeWallObj(wall.path(), 20, 10.0);
+	Model m(wall.path());
+	m.rotate(Rotation<Vec>(Vec(1, 0, 0), 0.3));
+	TriangleBVH bvh;
+	bvh.build(m.getVertices(), m.faces);
+	REQUIRE(bvh.getNbTriangles() == 800);
+	REQUIRE(bvh.getNodes().size() > 1);
+	// candidates = exactly the faces whose bounding box touches the sphere, each once
+	auto bruteForce = [&](const Vec &p, double r) {
+		vector<uint32_t> res;
+		for (size_t i = 0; i < m.faces.size(); ++i) {
+			TriangleBVH::AABB b;
+			for (const auto &v : m.faces[i].indices) b.grow(m.getVertices()[v]);
+			if (b.sqDistTo(p) <= r * r) res.push_back(i);
+		}
+		return res;
+	};
+	auto query = [](const TriangleBVH &t, const Vec &p, double r) {
+		vector<uint32_t> res;
+		t.forEachTriangleNear(p, r, [&](uint32_t f) { res.push_back(f); });
+		sort(res.begin(), res.end());
+		return res;
+	};
+	bool same = true;
+	for (double x = -100; x <= 100; x += 17) {
+		Vec p(x, 5, 0.5 * x);
+		same = same && !bruteForce(p, 25.0).empty() && query(bvh, p, 25.0) == bruteForce(p, 25.0);
+	}
+	REQUIRE(same);
+	// refit after a move = rebuild
+	m.translate(Vec(30, -10, 5));
+	bvh.refit(m.getVertices(), m.faces);
+	TriangleBVH fresh;
+	fresh.build(m.getVertices(), m.faces);
+	for (double x = -100; x <= 100; x += 17) {
+		Vec p(x + 30, 0, 0.5 * x);
+		same = same && query(bvh, p, 25.0) == bruteForce(p, 25.0) &&
+		       query(fresh, p, 25.0) == bruteForce(p, 25.0);
+	}
+	REQUIRE(same);
+	// in the world, cells resting on the wall get the same connections with both phases
+	size_t nbConnections[2];
+	for (int phase = 0; phase < 2; ++phase) {
+		BasicWorld<TestCell, Euler> w;
+		w.addModel("wall", wall.path());
+		if (phase == 1) w.setModelBroadPhase(ModelBroadPhase::bvh);
+		for (int i = -3; i <= 3; ++i) w.addCell(new TestCell(Vec(i * 25.0, 30.0, i * 10.0)));
+		w.update();
+		REQUIRE(w.getModelBVHs().size() == size_t(phase));
+		nbConnections[phase] = w.cellModelConnections.size();
+	}
+	REQUIRE(nbConnections[0] > 0);
+	REQUIRE(nbConnections[0] == nbConnections[1]);
+}
+
+TEST_CASE("Moving models") {
+	TempFile wall("wall.obj");
+	writeWallObj(wall.path(), 20, 10.0);
+	Model m(wall.path());
+	m.scale(Vec(2, 2, 2));
+	m.rotate(Rotation<Vec>(Vec(0, 0, 1), 0.4));
+	m.translate(Vec(10, -20, 5));
+	REQUIRE(abs(m.getInverseStretch() - 0.5) < 1e-9);
+	Vec p(12, 34, -56);
+	REQUIRE((m.toModelSpace(m.toWorldSpace(p)) - p).length() < 1e-9);
+	// face vertices computed on the fly = lazily updated mesh
+	auto tri = m.getFaceVertices(42);
+	REQUIRE((tri[1] - m.transformation * m.obj.vertices[m.faces[42].indices[1]]).length() < 1e-9);
+	REQUIRE((m.getVertices()[m.faces[42].indices[1]] - tri[1]).length() < 1e-9);
+	REQUIRE(abs(m.getNormals()[0].dot(Vec(-sin(0.4), cos(0.4), 0)) - 1.0) < 1e-9);
+	// a moving wall gives the same connections with the world space grid and the model
+	// space BVHs
+	BasicWorld<TestCell, Euler> w[2];
+	for (int phase = 0; phase < 2; ++phase) {
+		w[phase].addModel("wall", wall.path());
+		if (phase == 1) w[phase].setModelBroadPhase(ModelBroadPhase::bvh);
+		for (int i = -3; i <= 3; ++i)
+			for (int k = -3; k <= 3; ++k) w[phase].addCell(new TestCell(Vec(i * 25.0, 30.0, k * 25.0)));
+	}
+	// (cell index, face) of every cell-model connection
+	auto contents = [](BasicWorld<TestCell, Euler> &wo) {
+		vector<pair<size_t, size_t>> res;
+		for (const auto &cmc : wo.cellModelConnections) {
+			auto c = find(wo.cells.begin(), wo.cells.end(), cmc.bounce.getNode1());
+			res.emplace_back(c - wo.cells.begin(), cmc.bounce.getNode0().face);
+		}
+		sort(res.begin(), res.end());
+		return res;
+	};
+	bool same = true;
+	size_t nbConnections = 0;
+	for (int f = 0; f < 20; ++f) {
+		for (auto &wo : w) {
+			wo.models.at("wall").translate(Vec(0, 0.5, 0));
+			wo.models.at("wall").rotate(Rotation<Vec>(Vec(1, 0, 0), 0.005));
+			wo.update();
+		}
+		same = same && contents(w[0]) == contents(w[1]);
+		nbConnections += w[1].cellModelConnections.size();
+	}
+	REQUIRE(nbConnections > 0);
+	REQUIRE(same);
+	// a deformed wall (bump under the cells) gets its BVH refitted
+	for (auto &wo : w) {
+		Model &wall = wo.models.at("wall");
+		for (auto &v : wall.obj.vertices) v.y += 15.0 * exp(-(v.x * v.x + v.z * v.z) / 2000.0);
+		wall.verticesModified();
+		wo.update();
+	}
+	REQUIRE(contents(w[0]) == contents(w[1]));
+	const TriangleBVH &refitted = w[1].getModelBVHs().begin()->second;
+	TriangleBVH fresh;
+	fresh.build(w[1].models.at("wall").obj.vertices, w[1].models.at("wall").faces);
+	auto near = [](const TriangleBVH &t, const Vec &p) {
+		vector<uint32_t> res;
+		t.forEachTriangleNear(p, 5.0, [&](uint32_t f) { res.push_back(f); });
+		sort(res.begin(), res.end());
+		return res;
+	};
+	for (double x = -60; x <= 60; x += 15) {
+		Vec p(x, 15.0 * exp(-x * x / 2000.0), 0); // on the bump
+		same = same && !near(fresh, p).empty() && near(refitted, p) == near(fresh, p);
+	}
+	REQUIRE(same);
+	REQUIRE(refitted.getNbTriangles() == 800);
+}
+
+TEST_CASE("OBJ loading") {
+	TempFile file("load.obj");
+	{
+		ofstream f(file.path());
+		f << "# comment\r\n"
+		  << "o thing\n"
+		  << "v 1.5 -2.25e1 0.1\r\n"
+		  << "v  3 4 5\n"
+		  << "v 0.30000000000000004 -7 123456789012345678901\n"
+		  << "v 1 1 1\n"
+		  << "vt 0.25 0.75\n"
+		  << "vn 0 1 0\n"
+		  << "vn 0 0 -1\n"
+		  << "f 1/1/1 2/1/1 3/1/2\n"
+		  << "f 1//2 3//2 4//2\n"
+		  << "f -4 -3 -2 -1\n"; // quad without uv nor normals, relative indices
+	}
+	ObjModel o(file.path());
+	REQUIRE(o.vertices.size() == 4);
+	REQUIRE(o.vertices[0] == Vec(1.5, -22.5, stod("0.1")));
+	REQUIRE(o.vertices[2] == Vec(stod("0.30000000000000004"), -7, stod("123456789012345678901")));
+	REQUIRE(o.uv.size() == 1);
+	REQUIRE(o.normals.size() == 2);
+	REQUIRE(o.faces.size() == 4);
+	REQUIRE(o.faces[0].indices == (array<unsigned int, 3>{{0, 1, 2}}));
+	REQUIRE(o.faces[1].indices == (array<unsigned int, 3>{{0, 2, 3}}));
+	REQUIRE(o.faces[3].indices == (array<unsigned int, 3>{{0, 2, 3}}));
+	REQUIRE(o.normalFaces.size() == 4);
+	REQUIRE(o.normalFaces[0].indices == (array<unsigned int, 3>{{0, 0, 1}}));
+	REQUIRE(o.normalFaces[1].indices == (array<unsigned int, 3>{{1, 1, 1}}));
+	REQUIRE(o.uvFaces.size() == 4);
+	REQUIRE(o.uvFaces[1].indices == (array<unsigned int, 3>{{0, 0, 0}}));
+	// the model uses the vertex indices
+	Model m(file.path());
+	REQUIRE(m.faces.size() == 4);
+	REQUIRE(m.faces[1].indices == o.faces[1].indices);
+}
+
+TEST_CASE("Cell-model connections") {
+	TempFile wall("wall.obj");
+	writeWallObj(wall.path(), 20, 10.0);
+	BasicWorld<TestCell, Euler> w;
+	w.addModel("wall", wall.path());
+	for (int i = -3; i <= 3; ++i)
+		for (int k = -3; k <= 3; ++k) w.addCell(new TestCell(Vec(i * 25.0, 30.0, k * 25.0)));
+	// contiguous, sorted by (cell, model), and cells point to theirs
+	auto consistent = [&]() {
+		size_t nbPointers = 0;
+		bool ok = true;
+		for (auto &c : w.cells)
+			for (auto &cmc : c->getRWModelConnections()) {
+				++nbPointers;
+				ok = ok && cmc >= &w.cellModelConnections.front() &&
+				     cmc <= &w.cellModelConnections.back() && cmc->bounce.getNode1() == c;
+			}
+		for (size_t i = 1; i < w.cellModelConnections.size(); ++i)
+			ok = ok && w.cellModelConnections[i - 1].bounce.getNode1() <=
+			               w.cellModelConnections[i].bounce.getNode1();
+		return ok && nbPointers == w.cellModelConnections.size();
+	};
+	for (int i = 0; i < 5; ++i) w.update();
+	REQUIRE(w.cellModelConnections.size() >= w.cells.size());
+	REQUIRE(consistent());
+	for (size_t i = 0; i < w.cells.size(); i += 3) w.cells[i]->die();
+	w.update();
+	REQUIRE(consistent());
+	bool sameModel = true;
+	for (auto &cmc : w.cellModelConnections) sameModel = sameModel && cmc.model == &w.models.at("wall");
+	REQUIRE(sameModel);
+	w.removeModel("wall");
+	REQUIRE(w.models.empty());
+	REQUIRE(w.cellModelConnections.empty());
+	REQUIRE(consistent());
+	w.update();
+}
+
+TEST_CASE("Logging") {
+	ostringstream out;
+	Log::setSink(&out);
+	int evaluated = 0;
+	MECACELL_ERROR("error " << ++evaluated);
+	MECACELL_TRACE("trace " << ++evaluated); // arguments not evaluated when compiled out
+	Log::setLevel(MECACELL_LOG_NONE);
+	MECACELL_ERROR("hidden");
+	Log::setLevel(MECACELL_LOG_LEVEL);
+	const bool error = MECACELL_LOG_LEVEL >= MECACELL_LOG_ERROR;
+	const bool trace = MECACELL_LOG_LEVEL >= MECACELL_LOG_TRACE;
+	REQUIRE(evaluated == int(error) + int(trace));
+	REQUIRE(out.str().find("hidden") == string::npos);
+	REQUIRE((out.str().find("[error] error 1\n") == 0) == error);
+	// buffered file sink
+	TempFile log("log.txt");
+	REQUIRE(Log::setFile(log.path()));
+	MECACELL_LOG(MECACELL_LOG_ERROR, "to file");
+	Log::flush();
+	Log::setSink(&cerr);
+	ifstream f(log.path());
+	string line;
+	getline(f, line);
+	REQUIRE(line == (error ? "[error] to file" : ""));
+}
+
+TEST_CASE("Multi-level grid") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 8, 50.0);
+	for (size_t i = 0; i < w.cells.size(); i += 13) w.cells[i]->setRadius(200.0);
+	for (size_t i = 5; i < w.cells.size(); i += 17) w.cells[i]->setRadius(15.0);
+	MultiLevelGrid<TestCell *> g(2.5 * DEFAULT_CELL_RADIUS);
+	g.build(w.cells);
+	REQUIRE(g.getNbLevels() == 3);
+	REQUIRE(g.getNbItems() == w.cells.size());
+	set<pair<TestCell *, TestCell *>> pairs;
+	bool once = true;
+	g.forEachPair([&](TestCell *a, TestCell *b) {
+		once = once && a != b && pairs.insert({min(a, b), max(a, b)}).second;
+	});
+	REQUIRE(once);
+	bool allPairs = true;
+	for (size_t i = 0; i < w.cells.size(); ++i)
+		for (size_t j = i + 1; j < w.cells.size(); ++j) {
+			TestCell *a = w.cells[i], *b = w.cells[j];
+			if ((a->getPosition() - b->getPosition()).length() < a->getRadius() + b->getRadius())
+				allPairs = allPairs && pairs.count({min(a, b), max(a, b)});
+		}
+	REQUIRE(allPairs);
+	w.setBroadPhase(BroadPhase::multiLevel);
+	w.update();
+	REQUIRE(w.connections.size() > 0);
+}
+
+TEST_CASE("Grid cell size tuning") {
+	GridTuner t;
+	GridMeasure m;
+	m.nbStored = m.nbQueries = 1000;
+	m.storedRadii = m.queryRadii = vector<double>(10, 40.0);
+	// very coarse grid: lots of candidates, a smaller size should win
+	m.cellSize = 2000.0;
+	m.candidatesPerQuery = 500.0;
+	REQUIRE(t.evaluate(m) < 2000.0);
+	REQUIRE(t.getNbChanges() == 1);
+	// evaluating at the chosen size with the candidates it predicts must not move again
+	double s = t.getLastBestSize();
+	m.candidatesPerQuery *= pow(s + 80.0, 6) / pow(2080.0, 6) * pow(2000.0 / s, 3);
+	m.cellSize = s;
+	REQUIRE(t.evaluate(m) == s);
+	REQUIRE(t.getNbChanges() == 1);
+	// one object per bucket: creating the buckets costs more, larger buckets are better
+	m.occupancy = 1.0;
+	t.evaluate(m);
+	REQUIRE(t.getLastBestSize() > s);
+
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 8, 50.0);
+	w.setGridTuning(true);
+	w.getCellGridTuner().setPeriod(5);
+	for (int i = 0; i < 40; ++i) w.update();
+	REQUIRE(w.getCellGridTuner().getNbEvaluations() == 8);
+	REQUIRE(w.getCellGridTuner().getNbChanges() <= 1);
+	REQUIRE(w.getCellGrid().getCellSize() == w.getCellGridTuner().getLastMeasure().cellSize);
+}
+
+TEST_CASE("Parallel cell list build") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 12, 50.0);
+	ThreadPool pool(4);
+	pool.setGrain(16);
+	MortonCellList<TestCell *> serial(5.0 * DEFAULT_CELL_RADIUS),
+	    parallel(5.0 * DEFAULT_CELL_RADIUS);
+	serial.build(w.cells);
+	parallel.build(w.cells, pool);
+	REQUIRE(serial.getSortedOrder() == parallel.getSortedOrder());
+	REQUIRE(serial.getNbBuckets() == parallel.getNbBuckets());
+	REQUIRE(serial.getMaxRadius() == parallel.getMaxRadius());
+}
+
+TEST_CASE("Cell reordering") {
+	BasicWorld<TestCell, Euler> w;
+	fillLattice(w, 10, 50.0);
+	unsigned int seed = 7;
+	for (size_t i = w.cells.size() - 1; i > 0; --i) { // deterministic shuffle
+		seed = seed * 1103515245 + 12345;
+		swap(w.cells[i], w.cells[(seed >> 8) % (i + 1)]);
+	}
+	w.setStructureOfArrays(MECACELL_STRUCTURE_OF_ARRAYS);
+	w.update();
+	vector<TestCell *> before = w.cells;
+	vector<Vec> positions;
+	for (auto &c : before) positions.push_back(c->getPosition());
+	double shuffled = w.computeLocality();
+	size_t capacity = w.getConnectionPool().getCapacity();
+	w.reorderCells();
+	REQUIRE(w.getLocality() < 0.25 * shuffled);
+	REQUIRE(w.getNbReorderings() == 1);
+	bool samePositions = true, bound = true;
+	for (size_t i = 0; i < before.size(); ++i)
+		samePositions = samePositions && before[i]->getPosition() == positions[i];
+	for (size_t i = 0; i < w.cells.size() && w.getStructureOfArrays(); ++i)
+		bound = bound && w.cells[i]->getKinematicId() == i;
+	REQUIRE(samePositions);
+	REQUIRE(bound);
+	sort(before.begin(), before.end());
+	vector<TestCell *> after = w.cells;
+	sort(after.begin(), after.end());
+	REQUIRE(before == after);
+	// connections were moved to new slots: the cells must point to the new ones
+	set<BasicWorld<TestCell, Euler>::connect_type *> live(w.connections.begin(),
+	                                                        w.connections.end());
+	bool relocated = true;
+	for (auto &c : w.cells)
+		for (auto &con : c->getRWConnections()) relocated = relocated && live.count(con);
+	REQUIRE(relocated);
+	REQUIRE(w.getConnectionPool().getNbLive() == w.connections.size());
+	// relocated in place, in address order (except between chunks)
+	REQUIRE(w.getConnectionPool().getCapacity() == capacity);
+	size_t descents = 0;
+	for (size_t i = 1; i < w.connections.size(); ++i)
+		if (w.connections[i] < w.connections[i - 1]) ++descents;
+	REQUIRE(descents < w.getConnectionPool().getNbChunks());
+	w.setCellReordering(2);
+	for (int i = 0; i < 4; ++i) w.update();
+	REQUIRE(w.getNbReorderings() == 3);
+}
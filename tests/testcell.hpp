@@ -0,0 +1,65 @@
+#ifndef MECACELL_TESTCELL_HPP
+#define MECACELL_TESTCELL_HPP
+#include "../mecacell/mecacell.h"
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+// minimal cell type used by the tests
+class TestCell : public MecaCell::ConnectableCell<TestCell> {
+public:
+	TestCell(const MecaCell::Vec &p) : ConnectableCell(p) {}
+	TestCell(const TestCell &c, const MecaCell::Vec &translation)
+	    : ConnectableCell(c, translation) {}
+	double getAdhesionWith(const TestCell *) { return 0.8; }
+	TestCell *updateBehavior(double) { return nullptr; }
+};
+
+// fills w with a jittered cubic lattice of n*n*n overlapping cells (deterministic)
+template <typename W> void fillLattice(W &w, int n, double spacing = 60.0) {
+	unsigned int seed = 42;
+	auto jitter = [&]() {
+		seed = seed * 1103515245 + 12345;
+		return ((seed >> 16) % 1000) * 0.01 - 5.0;
+	};
+	for (int i = 0; i < n; ++i)
+		for (int j = 0; j < n; ++j)
+			for (int k = 0; k < n; ++k)
+				w.addCell(new TestCell(MecaCell::Vec(i * spacing + jitter(), j * spacing + jitter(),
+				                                     k * spacing + jitter())));
+}
+
+// path of a scratch file in the temporary directory (unique to the process), the file
+// being removed when the TempFile goes out of scope
+class TempFile {
+	std::string p;
+
+public:
+	TempFile(const std::string &name) {
+		const char *dir = std::getenv("TMPDIR");
+		p = std::string(dir && *dir ? dir : "/tmp") + "/mecacell_" + std::to_string(getpid()) +
+		    "_" + name;
+	}
+	~TempFile() { std::remove(p.c_str()); }
+	TempFile(const TempFile &) = delete;
+	TempFile &operator=(const TempFile &) = delete;
+	const std::string &path() const { return p; }
+};
+
+// writes a flat square wall of 2*n*n triangles in the xz plane, centered on 0
+inline void writeWallObj(const std::string &path, int n, double spacing) {
+	std::ofstream f(path);
+	const double o = -0.5 * n * spacing;
+	for (int i = 0; i <= n; ++i)
+		for (int k = 0; k <= n; ++k) f << "v " << o + i * spacing << " 0 " << o + k * spacing << "\n";
+	f << "vn 0 1 0\n";
+	auto id = [&](int i, int k) { return i * (n + 1) + k + 1; };
+	for (int i = 0; i < n; ++i)
+		for (int k = 0; k < n; ++k) {
+			f << "f " << id(i, k) << "//1 " << id(i + 1, k) << "//1 " << id(i + 1, k + 1) << "//1\n";
+			f << "f " << id(i, k) << "//1 " << id(i + 1, k + 1) << "//1 " << id(i, k + 1) << "//1\n";
+		}
+}
+#endif